@@ -0,0 +1,222 @@
+#!/bin/sh -
+#
+# Copyright (c) 2026 Shawn Webb <shawn.webb@hardenedbsd.org>
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+#
+# Loopback load-generation benchmark for hbsdmon. Generates a config
+# of N synthetic TCP/HTTP/UDP nodes pointed at hbsdmon-target, runs a
+# dry (-n) hbsdmon against it and reports sustained probes/sec,
+# schedule drift, late probes, main loop wake lag, RSS, thread count
+# and CPU time per probe.
+#
+# Usually run through `make bench BENCH_ARGS="..."`.
+#
+
+usage()
+{
+	cat 1>&2 <<USAGE
+usage: hbsdmon-bench.sh -H hbsdmon -T hbsdmon-target [-n nodes]
+           [-m tcp:http:udp] [-i interval] [-d duration] [-w warmup]
+           [-R refused_pct] [-B blackholed_pct] [-l latency_ms]
+           [-j jitter_ms] [-r reset_pct] [-s stall_pct] [-x drop_pct]
+           [-p port] [-k]
+USAGE
+	exit 1
+}
+
+cpu_seconds()
+{
+	# ps(1) reports CPU time as [[hh:]mm:]ss.hh
+	ps -o time= -p $1 | awk -F: '{
+		t = 0;
+		for (i = 1; i <= NF; i++)
+			t = t * 60 + $i;
+		printf("%.2f\n", t);
+	}'
+}
+
+hbsdmon=""
+target=""
+nodes=100
+mix="50:40:10"
+interval=10
+duration=60
+warmup=""
+refused=0
+blackholed=0
+latency=0
+jitter=0
+reset=0
+stall=0
+drop=0
+port=18080
+keep=0
+
+while getopts "B:d:H:i:j:kl:m:n:p:R:r:s:T:w:x:" o; do
+	case "${o}" in
+	B) blackholed=${OPTARG} ;;
+	d) duration=${OPTARG} ;;
+	H) hbsdmon=${OPTARG} ;;
+	i) interval=${OPTARG} ;;
+	j) jitter=${OPTARG} ;;
+	k) keep=1 ;;
+	l) latency=${OPTARG} ;;
+	m) mix=${OPTARG} ;;
+	n) nodes=${OPTARG} ;;
+	p) port=${OPTARG} ;;
+	R) refused=${OPTARG} ;;
+	r) reset=${OPTARG} ;;
+	s) stall=${OPTARG} ;;
+	T) target=${OPTARG} ;;
+	w) warmup=${OPTARG} ;;
+	x) drop=${OPTARG} ;;
+	*) usage ;;
+	esac
+done
+
+if [ -z "${hbsdmon}" -o -z "${target}" ]; then
+	usage
+fi
+
+if [ -z "${warmup}" ]; then
+	warmup=$((interval + 5))
+fi
+
+workdir=$(mktemp -d -t hbsdmon-bench) || exit 1
+conf=${workdir}/hbsdmon.conf
+log=${workdir}/hbsdmon.log
+
+#
+# Nodes are spread across methods according to the mix. A
+# percentage of TCP/HTTP nodes is pointed at the refusing and
+# blackholing ports instead of the service port.
+#
+awk -v nodes=${nodes} -v mix=${mix} -v interval=${interval} \
+    -v port=${port} -v refused=${refused} \
+    -v blackholed=${blackholed} 'BEGIN {
+	split(mix, m, ":");
+	total = m[1] + m[2] + m[3];
+	printf("{\n\tname: \"hbsdmon-bench\",\n");
+	printf("\ttoken: \"bench\",\n\tdest: \"bench\",\n");
+	printf("\tinterval: %d,\n", interval);
+	printf("\tinterval_min: %d,\n", interval);
+	printf("\tinterval_max: %d,\n", interval);
+	printf("\theartbeat: 86400,\n\tnodes: [\n");
+	for (i = 0; i < nodes; i++) {
+		slot = (i * 7919) % total;
+		p = port;
+		r = (i * 3571 + 41) % 100;
+		if (r < refused)
+			p = port + 1;
+		else if (r < refused + blackholed)
+			p = port + 2;
+		if (slot < m[1]) {
+			printf("\t\t{ host: \"127.0.0.1\", method: \"TCP\", " \
+			    "port: %d, addrfam: 4 },\n", p);
+		} else if (slot < m[1] + m[2]) {
+			printf("\t\t{ host: \"127.0.0.1:%d\", " \
+			    "method: \"HTTP\" },\n", p);
+		} else {
+			printf("\t\t{ host: \"127.0.0.1\", method: \"UDP\", " \
+			    "port: %d, addrfam: 4 },\n", port);
+		}
+	}
+	printf("\t]\n}\n");
+}' > ${conf}
+
+${target} -p ${port} -R $((port + 1)) -B $((port + 2)) \
+    -l ${latency} -j ${jitter} -r ${reset} -s ${stall} -d ${drop} \
+    2> ${workdir}/target.log &
+targetpid=$!
+
+${hbsdmon} -n -c ${conf} > /dev/null 2> ${log} &
+pid=$!
+
+cleanup()
+{
+	kill -TERM ${pid} ${targetpid} 2> /dev/null
+	wait ${pid} ${targetpid} 2> /dev/null
+	if [ ${keep} -eq 0 ]; then
+		rm -rf ${workdir}
+	else
+		echo "Work directory: ${workdir}"
+	fi
+}
+trap cleanup EXIT INT TERM
+
+sleep ${warmup}
+if ! kill -0 ${pid} 2> /dev/null; then
+	echo "hbsdmon exited during warmup:" 1>&2
+	tail ${log} 1>&2
+	exit 1
+fi
+
+# The first SIGINFO resets the counters at the start of the window.
+kill -INFO ${pid}
+cpu0=$(cpu_seconds ${pid})
+sleep ${duration}
+kill -INFO ${pid}
+cpu1=$(cpu_seconds ${pid})
+set -- $(ps -o rss= -o nlwp= -p ${pid})
+rss=$1
+nthreads=$2
+
+n=0
+while [ $(grep -c '^Probes:' ${log}) -lt 2 -a ${n} -lt 50 ]; do
+	sleep 0.1
+	n=$((n + 1))
+done
+
+probes=$(grep '^Probes:' ${log} | tail -n 1 | awk '{ print $2 }')
+if [ -z "${probes}" ]; then
+	echo "No stats from hbsdmon." 1>&2
+	exit 1
+fi
+
+awk -v nodes=${nodes} -v interval=${interval} -v duration=${duration} \
+    -v probes=${probes} -v cpu=$(echo "${cpu1} ${cpu0}" | \
+    awk '{ print $1 - $2 }') -v rss=${rss} -v nthreads=${nthreads} \
+    'BEGIN {
+	expected = nodes / interval;
+	rate = probes / duration;
+	printf("Nodes:              %d\n", nodes);
+	printf("Window:             %d s\n", duration);
+	printf("Probes:             %d\n", probes);
+	printf("Probes/sec:         %.2f (scheduled %.2f)\n", rate,
+	    expected);
+	printf("Schedule shortfall: %.2f%%\n",
+	    (expected - rate) * 100 / expected);
+	printf("RSS:                %d KiB\n", rss);
+	printf("Threads:            %d\n", nthreads);
+	printf("CPU time:           %.2f s\n", cpu);
+	if (probes > 0)
+		printf("CPU per probe:      %.1f us\n",
+		    cpu * 1000000 / probes);
+}'
+
+# Drift histograms and late counters from hbsdmon's last stats dump.
+awk '/^MONITOR STATS:/ { buf = ""; on = 1; next }
+    /^[A-Z][A-Z ]*:$/ { on = 0 }
+    on { buf = buf $0 "\n" }
+    END { printf("%s", buf) }' ${log} | sed -n '/^Late probes:/,$p'
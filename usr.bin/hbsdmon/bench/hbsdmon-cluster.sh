@@ -0,0 +1,172 @@
+#!/bin/sh -
+#
+# Copyright (c) 2026 Shawn Webb <shawn.webb@hardenedbsd.org>
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Loopback test of hbsdmon clustering. Starts several dry (-n)
+# instances sharing one set of nodes, all of which refuse
+# connections. Checks that the nodes are split between the
+# instances, that each failure is alerted exactly once, and that
+# killing an instance hands its nodes to the survivors without
+# alerting again.
+#
+# Usually run through `make cluster CLUSTER_ARGS="..."`.
+#
+
+usage()
+{
+	cat 1>&2 <<USAGE
+usage: hbsdmon-cluster.sh -H hbsdmon [-c instances] [-n nodes]
+           [-i interval] [-t timeout] [-p port] [-k]
+USAGE
+	exit 1
+}
+
+hbsdmon=""
+instances=3
+nodes=30
+interval=2
+timeout=2
+port=17001
+keep=0
+
+while getopts "c:H:i:kn:p:t:" o; do
+	case "${o}" in
+	c) instances=${OPTARG} ;;
+	H) hbsdmon=${OPTARG} ;;
+	i) interval=${OPTARG} ;;
+	k) keep=1 ;;
+	n) nodes=${OPTARG} ;;
+	p) port=${OPTARG} ;;
+	t) timeout=${OPTARG} ;;
+	*) usage ;;
+	esac
+done
+
+if [ -z "${hbsdmon}" -o ${instances} -lt 2 ]; then
+	usage
+fi
+
+workdir=$(mktemp -d -t hbsdmon-cluster) || exit 1
+pids=""
+
+cleanup()
+{
+	kill -TERM ${pids} 2> /dev/null
+	wait ${pids} 2> /dev/null
+	if [ ${keep} -eq 0 ]; then
+		rm -rf ${workdir}
+	else
+		echo "Work directory: ${workdir}"
+	fi
+}
+trap cleanup EXIT INT TERM
+
+# Nodes point at the ports after the cluster ports. Nothing listens
+# there.
+i=0
+while [ ${i} -lt ${instances} ]; do
+	awk -v id=${i} -v instances=${instances} -v nodes=${nodes} \
+	    -v interval=${interval} -v timeout=${timeout} \
+	    -v port=${port} 'BEGIN {
+		printf("{\n\tname: \"hbsdmon-cluster-%d\",\n", id);
+		printf("\ttoken: \"test\",\n\tdest: \"test\",\n");
+		printf("\tinterval: %d,\n", interval);
+		printf("\tinterval_min: %d,\n", interval);
+		printf("\tinterval_max: %d,\n", interval);
+		printf("\theartbeat: 86400,\n");
+		printf("\tcluster: {\n\t\tid: \"mon-%d\",\n", id);
+		printf("\t\tbind: \"tcp://127.0.0.1:%d\",\n", port + id);
+		printf("\t\ttimeout: %d,\n\t\tpeers: [\n", timeout);
+		for (j = 0; j < instances; j++)
+			if (j != id)
+				printf("\t\t\t\"tcp://127.0.0.1:%d\",\n",
+				    port + j);
+		printf("\t\t]\n\t},\n\tnodes: [\n");
+		for (j = 0; j < nodes; j++)
+			printf("\t\t{ host: \"127.0.0.1\", method: \"TCP\", " \
+			    "port: %d, addrfam: 4 },\n", port + instances + j);
+		printf("\t]\n}\n");
+	}' > ${workdir}/hbsdmon-${i}.conf
+
+	${hbsdmon} -n -c ${workdir}/hbsdmon-${i}.conf > /dev/null \
+	    2> ${workdir}/hbsdmon-${i}.log &
+	pids="${pids} $!"
+	i=$((i + 1))
+done
+
+owned()
+{
+	total=0
+	for pid in "$@"; do
+		kill -INFO ${pid}
+	done
+	sleep 1
+	for log in ${workdir}/hbsdmon-*.log; do
+		n=$(grep '^Owned nodes:' ${log} | tail -n 1 | \
+		    awk '{ print $3 }')
+		total=$((total + ${n:-0}))
+	done
+	echo ${total}
+}
+
+failures()
+{
+	cat ${workdir}/hbsdmon-*.log | grep -c '^NODE FAILURE:'
+}
+
+res=0
+
+sleep $((timeout + interval * 2 + 2))
+set -- ${pids}
+o=$(owned ${pids})
+f=$(failures)
+echo "${instances} instances: ${o} of ${nodes} nodes owned," \
+    "${f} failure alerts"
+if [ ${o} -ne ${nodes} -o ${f} -ne ${nodes} ]; then
+	res=1
+fi
+
+# Kill the first instance without letting it shut down, and remove
+# its stats so they aren't counted.
+kill -KILL $1
+wait $1 2> /dev/null
+mv ${workdir}/hbsdmon-0.log ${workdir}/dead.log
+shift
+pids="$*"
+
+sleep $((timeout + interval * 2 + 2))
+o=$(owned ${pids})
+f=$(($(failures) + $(grep -c '^NODE FAILURE:' ${workdir}/dead.log)))
+echo "$((instances - 1)) instances: ${o} of ${nodes} nodes owned," \
+    "${f} failure alerts"
+if [ ${o} -ne ${nodes} -o ${f} -ne ${nodes} ]; then
+	res=1
+fi
+
+if [ ${res} -eq 0 ]; then
+	echo "PASS"
+else
+	echo "FAIL"
+fi
+exit ${res}
@@ -0,0 +1,707 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Microbenchmarks for the data paths hbsdmon runs on every probe or
+ * alert. Results are written to stdout as JSON, one object per
+ * benchmark, in a fixed order, so runs can be diffed and tracked over
+ * time.
+ */
+
+#include <sys/param.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <ucl.h>
+
+#include "hbsdmon.h"
+
+#define	MB_NSEC		1000000000ULL
+
+typedef struct _mb_result {
+	const char		*mr_name;
+	const char		*mr_param;
+	uint64_t		 mr_param_val;
+	uint64_t		 mr_iterations;
+	uint64_t		 mr_nsec;
+	uint64_t		 mr_nallocs;
+} mb_result_t;
+
+typedef struct _mb_kv_arg {
+	hbsdmon_keyvalue_store_t	*mka_store;
+	pthread_barrier_t		*mka_barrier;
+	uint64_t			 mka_iterations;
+} mb_kv_arg_t;
+
+static uint64_t scale = 1;
+static const char *only;
+static bool first = true;
+
+/*
+ * Allocation accounting. malloc(3) and friends are interposed so that
+ * every allocation made by the code under test, including the ones
+ * made inside libc, libucl and libsbuf, is counted.
+ */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static _Atomic uint64_t nallocs;
+static _Atomic bool alloc_initializing;
+static char alloc_bootstrap[4096];
+static size_t alloc_bootstrap_used;
+
+static void
+mb_alloc_init(void)
+{
+
+	atomic_store(&alloc_initializing, true);
+	real_malloc = dlsym(RTLD_NEXT, "malloc");
+	real_calloc = dlsym(RTLD_NEXT, "calloc");
+	real_realloc = dlsym(RTLD_NEXT, "realloc");
+	real_free = dlsym(RTLD_NEXT, "free");
+	atomic_store(&alloc_initializing, false);
+}
+
+/* dlsym(3) may allocate before the real allocator is known. */
+static void *
+mb_alloc_bootstrap(size_t sz)
+{
+	void *p;
+
+	sz = (sz + 15) & ~((size_t)15);
+	if (alloc_bootstrap_used + sz > sizeof(alloc_bootstrap)) {
+		return (NULL);
+	}
+
+	p = alloc_bootstrap + alloc_bootstrap_used;
+	alloc_bootstrap_used += sz;
+	return (p);
+}
+
+static bool
+mb_is_bootstrap(void *p)
+{
+
+	return ((char *)p >= alloc_bootstrap &&
+	    (char *)p < alloc_bootstrap + sizeof(alloc_bootstrap));
+}
+
+void *
+malloc(size_t sz)
+{
+
+	if (real_malloc == NULL) {
+		if (atomic_load(&alloc_initializing)) {
+			return (mb_alloc_bootstrap(sz));
+		}
+		mb_alloc_init();
+	}
+
+	atomic_fetch_add_explicit(&nallocs, 1, memory_order_relaxed);
+	return (real_malloc(sz));
+}
+
+void *
+calloc(size_t n, size_t sz)
+{
+	void *p;
+
+	if (real_calloc == NULL) {
+		if (atomic_load(&alloc_initializing)) {
+			/* The bootstrap arena is static, thus zeroed. */
+			p = mb_alloc_bootstrap(n * sz);
+			return (p);
+		}
+		mb_alloc_init();
+	}
+
+	atomic_fetch_add_explicit(&nallocs, 1, memory_order_relaxed);
+	return (real_calloc(n, sz));
+}
+
+void *
+realloc(void *p, size_t sz)
+{
+	void *np;
+
+	if (real_realloc == NULL) {
+		mb_alloc_init();
+	}
+
+	if (p != NULL && mb_is_bootstrap(p)) {
+		np = malloc(sz);
+		if (np != NULL) {
+			memcpy(np, p, MIN(sz, (size_t)(alloc_bootstrap +
+			    sizeof(alloc_bootstrap) - (char *)p)));
+		}
+		return (np);
+	}
+
+	atomic_fetch_add_explicit(&nallocs, 1, memory_order_relaxed);
+	return (real_realloc(p, sz));
+}
+
+void
+free(void *p)
+{
+
+	if (p == NULL || mb_is_bootstrap(p)) {
+		return;
+	}
+
+	if (real_free == NULL) {
+		mb_alloc_init();
+	}
+
+	real_free(p);
+}
+
+static uint64_t
+mb_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * MB_NSEC + (uint64_t)ts.tv_nsec);
+}
+
+static bool
+mb_enabled(const char *name)
+{
+
+	return (only == NULL || strcmp(only, name) == 0);
+}
+
+static void
+mb_report(mb_result_t *res)
+{
+	double nsop, allocsop;
+
+	nsop = allocsop = 0;
+	if (res->mr_iterations > 0) {
+		nsop = (double)res->mr_nsec / (double)res->mr_iterations;
+		allocsop = (double)res->mr_nallocs /
+		    (double)res->mr_iterations;
+	}
+
+	printf("%s\n    {\"name\": \"%s\", ", first ? "" : ",",
+	    res->mr_name);
+	if (res->mr_param != NULL) {
+		printf("\"%s\": %ju, ", res->mr_param,
+		    (uintmax_t)res->mr_param_val);
+	}
+	printf("\"iterations\": %ju, \"ns_per_op\": %.1f, "
+	    "\"allocs_per_op\": %.2f}",
+	    (uintmax_t)res->mr_iterations, nsop, allocsop);
+	fflush(stdout);
+	first = false;
+}
+
+/*
+ * Build a context with one TCP node hooked up to a fake thread, the
+ * way hbsdmon_create_node_thread() would leave it.
+ */
+static hbsdmon_node_t *
+mb_new_node(hbsdmon_ctx_t **ctxp)
+{
+	hbsdmon_thread_t *thread;
+	hbsdmon_keyvalue_t *kv;
+	hbsdmon_node_t *node;
+	hbsdmon_ctx_t *ctx;
+	uint64_t val;
+	time_t now;
+	int port;
+
+	ctx = new_ctx();
+	assert(ctx != NULL);
+	ctx->hc_name = strdup(HBSDMON_DEFAULT_NAME);
+	pthread_mutex_init(&(ctx->hc_mtx), NULL);
+
+	now = time(NULL);
+	kv = hbsdmon_new_keyvalue();
+	hbsdmon_keyvalue_store(kv, "heartbeat", &now, sizeof(now));
+	hbsdmon_append_kv(ctx->hc_kvstore, kv);
+
+	val = 60;
+	kv = hbsdmon_new_keyvalue();
+	hbsdmon_keyvalue_store(kv, "interval", &val, sizeof(val));
+	hbsdmon_append_kv(ctx->hc_kvstore, kv);
+
+	node = hbsdmon_new_node();
+	assert(node != NULL);
+	node->hn_host = strdup("git-01.md.hardenedbsd.lan");
+	node->hn_method = METHOD_TCP;
+
+	port = 443;
+	kv = hbsdmon_new_keyvalue();
+	hbsdmon_keyvalue_store(kv, "port", &port, sizeof(port));
+	hbsdmon_node_append_kv(node, kv);
+
+	val = PF_INET;
+	kv = hbsdmon_new_keyvalue();
+	hbsdmon_keyvalue_store(kv, "addrfam", &val, sizeof(val));
+	hbsdmon_node_append_kv(node, kv);
+
+	kv = hbsdmon_new_keyvalue();
+	hbsdmon_keyvalue_store(kv, "failmsg", "Service: HTTPS",
+	    sizeof("Service: HTTPS"));
+	hbsdmon_node_append_kv(node, kv);
+	node->hn_failmsg = hbsdmon_keyvalue_to_str(kv);
+
+	thread = calloc(1, sizeof(*thread));
+	assert(thread != NULL);
+	thread->ht_ctx = ctx;
+	thread->ht_node = node;
+	node->hn_thread = thread;
+
+	SLIST_INSERT_HEAD(&(ctx->hc_nodes), node, hn_entry);
+	ctx->hc_nnodes++;
+
+	*ctxp = ctx;
+	return (node);
+}
+
+static void *
+mb_find_kv_thread(void *argp)
+{
+	mb_kv_arg_t *arg;
+	uint64_t i;
+
+	arg = argp;
+	pthread_barrier_wait(arg->mka_barrier);
+	for (i = 0; i < arg->mka_iterations; i++) {
+		/* "port" was inserted first, so it's the longest walk. */
+		if (hbsdmon_find_kv(arg->mka_store, "port", false) ==
+		    NULL) {
+			abort();
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Every node thread and the main thread share the lock of the store
+ * they look keys up in. Measure how lookups degrade as more threads
+ * contend on one store.
+ */
+static void
+mb_find_kv(void)
+{
+	static const uint64_t nthreads[] = { 1, 2, 4, 8, 16, 32, 64 };
+	pthread_barrier_t barrier;
+	hbsdmon_node_t *node;
+	hbsdmon_ctx_t *ctx;
+	pthread_t *tids;
+	mb_kv_arg_t arg;
+	mb_result_t res;
+	uint64_t start;
+	size_t i, j;
+
+	node = mb_new_node(&ctx);
+
+	for (i = 0; i < nitems(nthreads); i++) {
+		tids = calloc(nthreads[i], sizeof(*tids));
+		assert(tids != NULL);
+
+		pthread_barrier_init(&barrier, NULL, nthreads[i] + 1);
+		arg.mka_store = hbsdmon_node_kv(node);
+		arg.mka_barrier = &barrier;
+		arg.mka_iterations = 200000 * scale / nthreads[i];
+
+		for (j = 0; j < nthreads[i]; j++) {
+			if (pthread_create(&(tids[j]), NULL,
+			    mb_find_kv_thread, &arg)) {
+				abort();
+			}
+		}
+
+		atomic_store(&nallocs, 0);
+		pthread_barrier_wait(&barrier);
+		start = mb_now();
+		for (j = 0; j < nthreads[i]; j++) {
+			pthread_join(tids[j], NULL);
+		}
+
+		/*
+		 * ns_per_op is wall time per lookup across all threads,
+		 * so flat numbers mean perfect scaling.
+		 */
+		memset(&res, 0, sizeof(res));
+		res.mr_name = "find_kv";
+		res.mr_param = "threads";
+		res.mr_param_val = nthreads[i];
+		res.mr_nsec = mb_now() - start;
+		res.mr_iterations = arg.mka_iterations * nthreads[i];
+		res.mr_nallocs = atomic_load(&nallocs);
+		mb_report(&res);
+
+		pthread_barrier_destroy(&barrier);
+		free(tids);
+	}
+}
+
+static void
+mb_get_interval(void)
+{
+	hbsdmon_node_t *node;
+	hbsdmon_ctx_t *ctx;
+	mb_result_t res;
+	uint64_t i;
+	long total;
+
+	node = mb_new_node(&ctx);
+
+	memset(&res, 0, sizeof(res));
+	res.mr_name = "get_interval";
+	res.mr_iterations = 1000000 * scale;
+
+	total = 0;
+	atomic_store(&nallocs, 0);
+	res.mr_nsec = mb_now();
+	for (i = 0; i < res.mr_iterations; i++) {
+		total += hbsdmon_get_interval(node);
+	}
+	res.mr_nsec = mb_now() - res.mr_nsec;
+	res.mr_nallocs = atomic_load(&nallocs);
+	assert(total == 60 * (long)res.mr_iterations);
+
+	mb_report(&res);
+}
+
+static void
+mb_node_to_str(void)
+{
+	hbsdmon_node_t *node;
+	hbsdmon_ctx_t *ctx;
+	mb_result_t res;
+	uint64_t i;
+	char *str;
+
+	node = mb_new_node(&ctx);
+
+	memset(&res, 0, sizeof(res));
+	res.mr_name = "node_to_str";
+	res.mr_iterations = 100000 * scale;
+
+	atomic_store(&nallocs, 0);
+	res.mr_nsec = mb_now();
+	for (i = 0; i < res.mr_iterations; i++) {
+		str = hbsdmon_node_to_str(node);
+		assert(str != NULL);
+		free(str);
+	}
+	res.mr_nsec = mb_now() - res.mr_nsec;
+	res.mr_nallocs = atomic_load(&nallocs);
+
+	mb_report(&res);
+}
+
+/*
+ * The cached description used on the alert path. After the first
+ * call this should neither allocate nor look anything up.
+ */
+static void
+mb_node_desc(void)
+{
+	hbsdmon_node_t *node;
+	hbsdmon_ctx_t *ctx;
+	mb_result_t res;
+	const char *str;
+	uint64_t i;
+
+	node = mb_new_node(&ctx);
+
+	memset(&res, 0, sizeof(res));
+	res.mr_name = "node_desc";
+	res.mr_iterations = 1000000 * scale;
+
+	str = hbsdmon_node_desc(node);
+	assert(str != NULL);
+
+	atomic_store(&nallocs, 0);
+	res.mr_nsec = mb_now();
+	for (i = 0; i < res.mr_iterations; i++) {
+		str = hbsdmon_node_desc(node);
+		assert(str != NULL);
+	}
+	res.mr_nsec = mb_now() - res.mr_nsec;
+	res.mr_nallocs = atomic_load(&nallocs);
+
+	mb_report(&res);
+}
+
+static void
+mb_stats_to_str(void)
+{
+	hbsdmon_ctx_t *ctx;
+	mb_result_t res;
+	uint64_t i;
+	char *str;
+
+	mb_new_node(&ctx);
+
+	memset(&res, 0, sizeof(res));
+	res.mr_name = "stats_to_str";
+	res.mr_iterations = 100000 * scale;
+
+	atomic_store(&nallocs, 0);
+	res.mr_nsec = mb_now();
+	for (i = 0; i < res.mr_iterations; i++) {
+		str = hbsdmon_stats_to_str(ctx);
+		assert(str != NULL);
+		free(str);
+	}
+	res.mr_nsec = mb_now() - res.mr_nsec;
+	res.mr_nallocs = atomic_load(&nallocs);
+
+	mb_report(&res);
+}
+
+static char *
+mb_gen_config(size_t nnodes)
+{
+	char *path;
+	size_t i;
+	FILE *fp;
+	int fd;
+
+	path = strdup("/tmp/hbsdmon-microbench.XXXXXX");
+	assert(path != NULL);
+	fd = mkstemp(path);
+	if (fd == -1) {
+		perror("mkstemp");
+		exit(1);
+	}
+
+	fp = fdopen(fd, "w");
+	assert(fp != NULL);
+
+	fprintf(fp, "{\n\ttoken: \"bench\",\n\tdest: \"bench\",\n"
+	    "\tinterval: 60,\n\tnodes: [\n");
+	for (i = 0; i < nnodes; i++) {
+		switch (i % 3) {
+		case 0:
+			fprintf(fp, "\t\t{ host: \"node-%zu.example.org\", "
+			    "method: \"TCP\", port: 22, addrfam: 4, "
+			    "messages: { fail: \"Service: SSH\" } },\n", i);
+			break;
+		case 1:
+			fprintf(fp, "\t\t{ host: \"node-%zu.example.org\", "
+			    "method: \"HTTP\", interval: 30 },\n", i);
+			break;
+		default:
+			fprintf(fp, "\t\t{ host: \"node-%zu.example.org\", "
+			    "method: \"UDP\", port: 53 },\n", i);
+			break;
+		}
+	}
+	fprintf(fp, "\t]\n}\n");
+	fclose(fp);
+
+	return (path);
+}
+
+static void
+mb_parse_config(void)
+{
+	static const uint64_t sizes[] = { 1000, 10000, 100000 };
+	hbsdmon_ctx_t *ctx;
+	mb_result_t res;
+	uint64_t start;
+	size_t i, j;
+	char *path;
+
+	for (i = 0; i < nitems(sizes); i++) {
+		path = mb_gen_config(sizes[i]);
+
+		memset(&res, 0, sizeof(res));
+		res.mr_name = "parse_config";
+		res.mr_param = "nodes";
+		res.mr_param_val = sizes[i];
+		res.mr_iterations = MAX(1, 100000 * scale / sizes[i] / 10);
+
+		for (j = 0; j < res.mr_iterations; j++) {
+			/* Contexts are leaked: there's no way to free one. */
+			ctx = new_ctx();
+			assert(ctx != NULL);
+			ctx->hc_config = path;
+
+			atomic_store(&nallocs, 0);
+			start = mb_now();
+			if (parse_config(ctx) == false) {
+				fprintf(stderr, "parse_config failed\n");
+				exit(1);
+			}
+			res.mr_nsec += mb_now() - start;
+			res.mr_nallocs += atomic_load(&nallocs);
+		}
+
+		mb_report(&res);
+		unlink(path);
+		free(path);
+	}
+}
+
+static void *
+mb_zmq_echo(void *argp)
+{
+	hbsdmon_thread_msg_t msg;
+	void *sock;
+
+	sock = zmq_socket(argp, ZMQ_PAIR);
+	assert(sock != NULL);
+	if (zmq_connect(sock, "inproc://microbench")) {
+		abort();
+	}
+
+	zmq_send(sock, NULL, 0, 0);
+	while (zmq_recv(sock, &msg, sizeof(msg), 0) == sizeof(msg)) {
+		if (msg.htm_verb == VERB_TERM) {
+			break;
+		}
+		zmq_send(sock, &msg, sizeof(msg), 0);
+	}
+
+	zmq_close(sock);
+	return (NULL);
+}
+
+/*
+ * Round trip of a hbsdmon_thread_msg_t between the main thread and a
+ * node thread over the inproc ZMQ_PAIR sockets they talk through.
+ */
+static void
+mb_thread_msg(void)
+{
+	hbsdmon_thread_msg_t msg;
+	mb_result_t res;
+	pthread_t tid;
+	void *zmq, *sock;
+	uint64_t i;
+
+	zmq = zmq_ctx_new();
+	assert(zmq != NULL);
+	sock = zmq_socket(zmq, ZMQ_PAIR);
+	assert(sock != NULL);
+	if (zmq_bind(sock, "inproc://microbench")) {
+		abort();
+	}
+
+	if (pthread_create(&tid, NULL, mb_zmq_echo, zmq)) {
+		abort();
+	}
+	zmq_recv(sock, NULL, 0, 0);
+
+	memset(&res, 0, sizeof(res));
+	res.mr_name = "thread_msg_roundtrip";
+	res.mr_iterations = 100000 * scale;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.htm_verb = VERB_HEARTBEAT;
+
+	atomic_store(&nallocs, 0);
+	res.mr_nsec = mb_now();
+	for (i = 0; i < res.mr_iterations; i++) {
+		zmq_send(sock, &msg, sizeof(msg), 0);
+		if (zmq_recv(sock, &msg, sizeof(msg), 0) != sizeof(msg)) {
+			abort();
+		}
+	}
+	res.mr_nsec = mb_now() - res.mr_nsec;
+	res.mr_nallocs = atomic_load(&nallocs);
+
+	msg.htm_verb = VERB_TERM;
+	zmq_send(sock, &msg, sizeof(msg), 0);
+	pthread_join(tid, NULL);
+	zmq_close(sock);
+	zmq_ctx_term(zmq);
+
+	mb_report(&res);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: hbsdmon-microbench [-b benchmark] "
+	    "[-s scale]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int ch;
+
+	while ((ch = getopt(argc, argv, "b:s:")) != -1) {
+		switch (ch) {
+		case 'b':
+			only = optarg;
+			break;
+		case 's':
+			scale = strtoull(optarg, NULL, 10);
+			if (scale == 0) {
+				usage();
+			}
+			break;
+		default:
+			usage();
+		}
+	}
+
+	printf("{\n  \"version\": 1,\n  \"scale\": %ju,\n"
+	    "  \"benchmarks\": [", (uintmax_t)scale);
+
+	if (mb_enabled("find_kv"))
+		mb_find_kv();
+	if (mb_enabled("get_interval"))
+		mb_get_interval();
+	if (mb_enabled("node_to_str"))
+		mb_node_to_str();
+	if (mb_enabled("node_desc"))
+		mb_node_desc();
+	if (mb_enabled("stats_to_str"))
+		mb_stats_to_str();
+	if (mb_enabled("parse_config"))
+		mb_parse_config();
+	if (mb_enabled("thread_msg_roundtrip"))
+		mb_thread_msg();
+
+	printf("\n  ]\n}\n");
+
+	return (0);
+}
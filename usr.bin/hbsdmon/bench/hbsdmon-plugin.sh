@@ -0,0 +1,153 @@
+#!/bin/sh -
+#
+# Copyright (c) 2026 Shawn Webb <shawn.webb@hardenedbsd.org>
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Loopback test of probe plugins, using the sample connect plugin.
+# Starts a dry (-n) instance with nodes pointed at hbsdmon-target and
+# nodes pointed at ports nothing listens on. The down nodes must be
+# alerted, exactly once each, and the nodes must have been probed in
+# batches rather than one at a time.
+#
+# With -e, the interval is an hour, and the nodes must be probed when
+# the plugin wakes them up through its descriptor.
+#
+# Usually run through `make plugin PLUGIN_ARGS="..."`.
+#
+
+usage()
+{
+	cat 1>&2 <<USAGE
+usage: hbsdmon-plugin.sh -H hbsdmon -T hbsdmon-target -P connect.so
+           [-u up_nodes] [-d down_nodes] [-i interval] [-p port] [-e]
+           [-k]
+USAGE
+	exit 1
+}
+
+hbsdmon=""
+target=""
+plugin=""
+up=50
+down=10
+interval=2
+port=17201
+events=0
+keep=0
+
+while getopts "d:eH:i:kP:p:T:u:" o; do
+	case "${o}" in
+	d) down=${OPTARG} ;;
+	e) events=1 ;;
+	H) hbsdmon=${OPTARG} ;;
+	i) interval=${OPTARG} ;;
+	k) keep=1 ;;
+	P) plugin=${OPTARG} ;;
+	p) port=${OPTARG} ;;
+	T) target=${OPTARG} ;;
+	u) up=${OPTARG} ;;
+	*) usage ;;
+	esac
+done
+
+if [ -z "${hbsdmon}" -o -z "${target}" -o -z "${plugin}" ]; then
+	usage
+fi
+
+workdir=$(mktemp -d -t hbsdmon-plugin) || exit 1
+pids=""
+
+cleanup()
+{
+	kill -TERM ${pids} 2> /dev/null
+	wait ${pids} 2> /dev/null
+	if [ ${keep} -eq 0 ]; then
+		rm -rf ${workdir}
+	else
+		echo "Work directory: ${workdir}"
+	fi
+}
+trap cleanup EXIT INT TERM
+
+${target} -p ${port} 2> ${workdir}/target.log &
+pids="$!"
+
+probeinterval=${interval}
+if [ ${events} -eq 1 ]; then
+	probeinterval=3600
+	mkfifo ${workdir}/wake || exit 1
+	HBSDMON_CONNECT_WAKE=${workdir}/wake
+	export HBSDMON_CONNECT_WAKE
+fi
+
+awk -v up=${up} -v down=${down} -v interval=${probeinterval} \
+    -v port=${port} -v plugin=${plugin} 'BEGIN {
+	printf("{\n\tname: \"hbsdmon-plugin\",\n");
+	printf("\ttoken: \"test\",\n\tdest: \"test\",\n");
+	printf("\tinterval: %d,\n", interval);
+	printf("\tinterval_min: %d,\n", interval);
+	printf("\tinterval_max: %d,\n", interval);
+	printf("\theartbeat: 86400,\n");
+	printf("\tplugins: [ \"%s\" ],\n", plugin);
+	printf("\tnodes: [\n");
+	for (j = 0; j < up; j++)
+		printf("\t\t{ host: \"127.0.0.1\", " \
+		    "method: \"connect\", port: %d },\n", port);
+	for (j = 0; j < down; j++)
+		printf("\t\t{ host: \"127.0.0.1\", method: \"connect\", " \
+		    "port: %d },\n", port + 1 + j);
+	printf("\t]\n}\n");
+}' > ${workdir}/hbsdmon.conf
+
+${hbsdmon} -n -c ${workdir}/hbsdmon.conf > /dev/null \
+    2> ${workdir}/hbsdmon.log &
+pid=$!
+pids="${pids} ${pid}"
+
+if [ ${events} -eq 1 ]; then
+	sleep 2
+	echo wake > ${workdir}/wake
+	sleep 3
+else
+	sleep $((interval * 3 + 2))
+fi
+
+kill -INFO ${pid}
+sleep 1
+
+failures=$(grep -c '^NODE FAILURE:' ${workdir}/hbsdmon.log)
+batches=$(grep '^Plugin batches:' ${workdir}/hbsdmon.log | tail -n 1 | \
+    awk '{ print $3 }')
+probes=$(grep '^Plugin batches:' ${workdir}/hbsdmon.log | tail -n 1 | \
+    awk '{ print $4 }' | tr -d '(')
+
+echo "${failures} failure alerts for ${down} down nodes," \
+    "${probes:-0} probes in ${batches:-0} batches"
+
+if [ ${failures} -eq ${down} -a ${batches:-0} -gt 0 -a \
+    ${batches:-0} -lt ${probes:-0} ]; then
+	echo "PASS"
+	exit 0
+fi
+echo "FAIL"
+exit 1
@@ -0,0 +1,293 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * connect.so is a sample hbsdmon probe plugin, also used by the
+ * plugin loopback test. It defines the "connect" method, which
+ * checks that a TCP port accepts connections. A whole batch of
+ * nodes is connected to at once, with one poll(2) for all of them.
+ *
+ * When HBSDMON_CONNECT_WAKE names a FIFO, every line written to it
+ * has every connect node probed right away.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "hbsdmon_plugin.h"
+
+typedef struct _connect_target {
+	int			 ct_port;
+	char			 ct_service[8];
+} connect_target_t;
+
+static int connect_wakefd = -1;
+
+static uint64_t
+connect_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static void
+connect_time(hbsdmon_plugin_target_t *target, int phase, uint64_t us)
+{
+
+	target->hpt_phases[phase] = us;
+	target->hpt_valid |= 1 << phase;
+}
+
+static bool
+connect_init(void)
+{
+	const char *path;
+
+	path = getenv("HBSDMON_CONNECT_WAKE");
+	if (path == NULL) {
+		return (true);
+	}
+
+	/* Opened for writing too, so it never reports EOF. */
+	connect_wakefd = open(path, O_RDWR | O_NONBLOCK);
+	if (connect_wakefd == -1) {
+		perror(path);
+		return (false);
+	}
+
+	return (true);
+}
+
+static void
+connect_fini(void)
+{
+
+	if (connect_wakefd != -1) {
+		close(connect_wakefd);
+		connect_wakefd = -1;
+	}
+}
+
+static bool
+connect_parse(const char *host, const ucl_object_t *obj, void **argp)
+{
+	const ucl_object_t *ucl_port;
+	connect_target_t *target;
+	int64_t port;
+
+	ucl_port = ucl_lookup_path(obj, ".port");
+	if (ucl_port == NULL || !ucl_object_toint_safe(ucl_port, &port) ||
+	    port <= 0 || port > 65535) {
+		fprintf(stderr, "[-] connect: %s needs a port.\n", host);
+		return (false);
+	}
+
+	target = calloc(1, sizeof(*target));
+	if (target == NULL) {
+		return (false);
+	}
+	target->ct_port = (int)port;
+	snprintf(target->ct_service, sizeof(target->ct_service), "%d",
+	    target->ct_port);
+
+	*argp = target;
+	return (true);
+}
+
+static void
+connect_free(void *arg)
+{
+
+	free(arg);
+}
+
+static int
+connect_desc(void *arg, char *buf, size_t len)
+{
+	connect_target_t *target;
+
+	target = arg;
+	return (snprintf(buf, len, "port %d", target->ct_port));
+}
+
+/*
+ * Start a non-blocking connect to every target, then wait for all of
+ * them at once. Name lookups are done first, one after the other.
+ */
+static void
+connect_probe(hbsdmon_plugin_target_t *targets, size_t n,
+    uint64_t timeout_ms)
+{
+	struct addrinfo hints, *ai;
+	connect_target_t *target;
+	struct pollfd *pfds;
+	uint64_t deadline, now, start;
+	size_t i, npending;
+	socklen_t errlen;
+	int err, fd;
+
+	pfds = calloc(n, sizeof(*pfds));
+	if (pfds == NULL) {
+		return;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV;
+
+	npending = 0;
+	start = connect_now_us();
+	for (i = 0; i < n; i++) {
+		pfds[i].fd = -1;
+		target = targets[i].hpt_arg;
+
+		now = connect_now_us();
+		if (getaddrinfo(targets[i].hpt_host, target->ct_service,
+		    &hints, &ai)) {
+			targets[i].hpt_ok = false;
+			targets[i].hpt_failed = HBSDMON_PLUGIN_PHASE_DNS;
+			continue;
+		}
+		connect_time(&targets[i], HBSDMON_PLUGIN_PHASE_DNS,
+		    connect_now_us() - now);
+
+		now = connect_now_us();
+		fd = socket(ai->ai_family, ai->ai_socktype |
+		    SOCK_NONBLOCK, ai->ai_protocol);
+		if (fd == -1 || (connect(fd, ai->ai_addr,
+		    ai->ai_addrlen) == -1 && errno != EINPROGRESS)) {
+			if (fd != -1) {
+				close(fd);
+			}
+			freeaddrinfo(ai);
+			targets[i].hpt_ok = false;
+			targets[i].hpt_failed = HBSDMON_PLUGIN_PHASE_CONNECT;
+			continue;
+		}
+		freeaddrinfo(ai);
+
+		/* Until it's connected, the phase holds its start. */
+		targets[i].hpt_phases[HBSDMON_PLUGIN_PHASE_CONNECT] = now;
+		pfds[i].fd = fd;
+		pfds[i].events = POLLOUT;
+		npending++;
+	}
+
+	deadline = start + timeout_ms * 1000;
+	while (npending > 0) {
+		now = connect_now_us();
+		if (now >= deadline ||
+		    poll(pfds, n, (deadline - now + 999) / 1000) <= 0) {
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (pfds[i].fd == -1 || pfds[i].revents == 0) {
+				continue;
+			}
+
+			err = 0;
+			errlen = sizeof(err);
+			if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &err,
+			    &errlen) == -1 || err != 0) {
+				targets[i].hpt_ok = false;
+				targets[i].hpt_failed =
+				    HBSDMON_PLUGIN_PHASE_CONNECT;
+			} else {
+				connect_time(&targets[i],
+				    HBSDMON_PLUGIN_PHASE_CONNECT,
+				    connect_now_us() - targets[i].hpt_phases[
+				    HBSDMON_PLUGIN_PHASE_CONNECT]);
+			}
+			close(pfds[i].fd);
+			pfds[i].fd = -1;
+			npending--;
+		}
+	}
+
+	/* Whatever is left timed out. */
+	for (i = 0; i < n; i++) {
+		if (pfds[i].fd == -1) {
+			continue;
+		}
+		close(pfds[i].fd);
+		targets[i].hpt_ok = false;
+		targets[i].hpt_failed = HBSDMON_PLUGIN_PHASE_CONNECT;
+	}
+
+	free(pfds);
+}
+
+static int
+connect_fd(void)
+{
+
+	return (connect_wakefd);
+}
+
+static size_t
+connect_ready(void **args, size_t max)
+{
+	char buf[512];
+	bool woken;
+
+	woken = false;
+	while (read(connect_wakefd, buf, sizeof(buf)) > 0) {
+		woken = true;
+	}
+
+	if (!woken || max == 0) {
+		return (0);
+	}
+
+	args[0] = NULL;
+	return (1);
+}
+
+const hbsdmon_plugin_t hbsdmon_plugin = {
+	.hp_abi =	HBSDMON_PLUGIN_ABI,
+	.hp_method =	"connect",
+	.hp_init =	connect_init,
+	.hp_fini =	connect_fini,
+	.hp_parse =	connect_parse,
+	.hp_free =	connect_free,
+	.hp_desc =	connect_desc,
+	.hp_probe =	connect_probe,
+	.hp_fd =	connect_fd,
+	.hp_ready =	connect_ready,
+};
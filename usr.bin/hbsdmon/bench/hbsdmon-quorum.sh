@@ -0,0 +1,154 @@
+#!/bin/sh -
+#
+# Copyright (c) 2026 Shawn Webb <shawn.webb@hardenedbsd.org>
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Loopback test of quorum confirmation. Starts several dry (-n)
+# instances with a quorum of two. One instance simulates losing
+# its uplink: it sees every healthy node as unreachable. The others
+# must refute those failures. Nodes that really are down (pointed
+# at a port nothing listens on) must still be alerted, exactly once
+# each.
+#
+# Usually run through `make quorum QUORUM_ARGS="..."`.
+#
+
+usage()
+{
+	cat 1>&2 <<USAGE
+usage: hbsdmon-quorum.sh -H hbsdmon -T hbsdmon-target [-c instances]
+           [-u up_nodes] [-d down_nodes] [-i interval] [-t timeout]
+           [-p port] [-k]
+USAGE
+	exit 1
+}
+
+hbsdmon=""
+target=""
+instances=3
+up=20
+down=10
+interval=2
+timeout=2
+port=17101
+keep=0
+
+while getopts "c:d:H:i:kp:T:t:u:" o; do
+	case "${o}" in
+	c) instances=${OPTARG} ;;
+	d) down=${OPTARG} ;;
+	H) hbsdmon=${OPTARG} ;;
+	i) interval=${OPTARG} ;;
+	k) keep=1 ;;
+	p) port=${OPTARG} ;;
+	T) target=${OPTARG} ;;
+	t) timeout=${OPTARG} ;;
+	u) up=${OPTARG} ;;
+	*) usage ;;
+	esac
+done
+
+if [ -z "${hbsdmon}" -o -z "${target}" -o ${instances} -lt 3 ]; then
+	usage
+fi
+
+workdir=$(mktemp -d -t hbsdmon-quorum) || exit 1
+targetport=$((port + instances))
+pids=""
+
+cleanup()
+{
+	kill -TERM ${pids} 2> /dev/null
+	wait ${pids} 2> /dev/null
+	if [ ${keep} -eq 0 ]; then
+		rm -rf ${workdir}
+	else
+		echo "Work directory: ${workdir}"
+	fi
+}
+trap cleanup EXIT INT TERM
+
+${target} -p ${targetport} 2> ${workdir}/target.log &
+pids="$!"
+
+# Healthy nodes are HTTP nodes with distinct paths on the target.
+# Down nodes point at the ports after the target's.
+i=0
+while [ ${i} -lt ${instances} ]; do
+	awk -v id=${i} -v instances=${instances} -v up=${up} \
+	    -v down=${down} -v interval=${interval} \
+	    -v timeout=${timeout} -v port=${port} \
+	    -v targetport=${targetport} 'BEGIN {
+		printf("{\n\tname: \"hbsdmon-quorum-%d\",\n", id);
+		printf("\ttoken: \"test\",\n\tdest: \"test\",\n");
+		printf("\tinterval: %d,\n", interval);
+		printf("\tinterval_min: %d,\n", interval);
+		printf("\tinterval_max: %d,\n", interval);
+		printf("\theartbeat: 86400,\n");
+		printf("\tcluster: {\n\t\tid: \"mon-%d\",\n", id);
+		printf("\t\tbind: \"tcp://127.0.0.1:%d\",\n", port + id);
+		printf("\t\ttimeout: %d,\n\t\tquorum: 2,\n", timeout);
+		printf("\t\tpeers: [\n");
+		for (j = 0; j < instances; j++)
+			if (j != id)
+				printf("\t\t\t\"tcp://127.0.0.1:%d\",\n",
+				    port + j);
+		printf("\t\t]\n\t},\n\tnodes: [\n");
+		for (j = 0; j < up; j++)
+			printf("\t\t{ host: \"127.0.0.1:%d/%d\", " \
+			    "method: \"HTTP\"%s },\n", targetport, j,
+			    id == 0 ? ", simulate_unreachable: true" : "");
+		for (j = 0; j < down; j++)
+			printf("\t\t{ host: \"127.0.0.1\", method: \"TCP\", " \
+			    "port: %d, addrfam: 4 },\n", targetport + 1 + j);
+		printf("\t]\n}\n");
+	}' > ${workdir}/hbsdmon-${i}.conf
+
+	${hbsdmon} -n -c ${workdir}/hbsdmon-${i}.conf > /dev/null \
+	    2> ${workdir}/hbsdmon-${i}.log &
+	pids="${pids} $!"
+	i=$((i + 1))
+done
+
+sleep $((timeout + interval * 3 + 2))
+
+set -- ${pids}
+shift
+for pid in "$@"; do
+	kill -INFO ${pid}
+done
+sleep 1
+
+failures=$(cat ${workdir}/hbsdmon-*.log | grep -c '^NODE FAILURE:')
+refuted=$(grep '^Refuted failures:' ${workdir}/hbsdmon-0.log | \
+    tail -n 1 | awk '{ print $3 }')
+
+echo "${failures} failure alerts for ${down} down nodes," \
+    "${refuted:-0} failures refuted for mon-0"
+
+if [ ${failures} -eq ${down} -a ${refuted:-0} -gt 0 ]; then
+	echo "PASS"
+	exit 0
+fi
+echo "FAIL"
+exit 1
@@ -0,0 +1,551 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * hbsdmon-target is the loopback target daemon used by the hbsdmon
+ * benchmark harness. It answers TCP and HTTP probes on one port and
+ * echoes UDP probes on the same port number. It can inject latency,
+ * connection resets, stalled responses and datagram loss, and it can
+ * hold a port that refuses connections and a port that blackholes
+ * them.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define	TARGET_MAXCONNS		65536
+#define	TARGET_MAXDGRAMS	4096
+#define	TARGET_DGRAMSZ		512
+
+#define	HTTP_RESPONSE	"HTTP/1.1 200 OK\r\n" \
+			"Content-Length: 0\r\n" \
+			"Connection: close\r\n\r\n"
+
+typedef enum _target_conn_state {
+	CONN_READING,
+	CONN_DELAYED,
+	CONN_STALLED,
+} target_conn_state_t;
+
+typedef struct _target_conn {
+	int			 tc_fd;
+	target_conn_state_t	 tc_state;
+	uint32_t		 tc_match;
+	struct timespec		 tc_due;
+} target_conn_t;
+
+typedef struct _target_dgram {
+	struct sockaddr_storage	 td_addr;
+	socklen_t		 td_addrlen;
+	size_t			 td_len;
+	struct timespec		 td_due;
+	char			 td_buf[TARGET_DGRAMSZ];
+} target_dgram_t;
+
+typedef struct _target_stats {
+	uint64_t		 ts_naccepted;
+	uint64_t		 ts_nreset;
+	uint64_t		 ts_nstalled;
+	uint64_t		 ts_nresponded;
+	uint64_t		 ts_ndgrams;
+	uint64_t		 ts_ndropped;
+} target_stats_t;
+
+typedef struct _target_ctx {
+	int			 tx_listenfd;
+	int			 tx_udpfd;
+	int			 tx_refusefd;
+	int			 tx_blackholefd;
+	long			 tx_latency;
+	long			 tx_jitter;
+	unsigned int		 tx_resetpct;
+	unsigned int		 tx_stallpct;
+	unsigned int		 tx_droppct;
+	size_t			 tx_nconns;
+	target_conn_t		*tx_conns;
+	size_t			 tx_ndgrams;
+	target_dgram_t		*tx_dgrams;
+	target_stats_t		 tx_stats;
+} target_ctx_t;
+
+static volatile sig_atomic_t gotterm;
+static volatile sig_atomic_t gotinfo;
+
+static void sighandler(int);
+static void usage(void);
+static int bind_port(int, int);
+static bool chance(unsigned int);
+static void schedule(target_ctx_t *, struct timespec *);
+static long ms_until(const struct timespec *, const struct timespec *);
+static void accept_conns(target_ctx_t *);
+static void handle_conn(target_ctx_t *, size_t);
+static void close_conn(target_ctx_t *, size_t);
+static void handle_udp(target_ctx_t *);
+static void run_timers(target_ctx_t *, const struct timespec *);
+static void print_stats(target_ctx_t *);
+
+int
+main(int argc, char *argv[])
+{
+	struct pollfd *pfds;
+	struct timespec now;
+	target_ctx_t ctx;
+	long timeout, ms;
+	size_t i, npfds;
+	int ch, port;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.tx_refusefd = ctx.tx_blackholefd = -1;
+	port = 0;
+
+	while ((ch = getopt(argc, argv, "B:d:j:l:p:R:r:s:")) != -1) {
+		switch (ch) {
+		case 'B':
+			/*
+			 * Listening, but never accepting. Once the
+			 * listen queue is full, further SYNs are
+			 * dropped and connects hang.
+			 */
+			ctx.tx_blackholefd = bind_port(atoi(optarg),
+			    SOCK_STREAM);
+			if (ctx.tx_blackholefd == -1 ||
+			    listen(ctx.tx_blackholefd, 0)) {
+				perror("[-] blackhole port");
+				return (1);
+			}
+			break;
+		case 'd':
+			ctx.tx_droppct = atoi(optarg);
+			break;
+		case 'j':
+			ctx.tx_jitter = atol(optarg);
+			break;
+		case 'l':
+			ctx.tx_latency = atol(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'R':
+			/* Bound, but never listening: connects are refused. */
+			ctx.tx_refusefd = bind_port(atoi(optarg),
+			    SOCK_STREAM);
+			if (ctx.tx_refusefd == -1) {
+				perror("[-] refuse port");
+				return (1);
+			}
+			break;
+		case 'r':
+			ctx.tx_resetpct = atoi(optarg);
+			break;
+		case 's':
+			ctx.tx_stallpct = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (port <= 0) {
+		usage();
+	}
+
+	ctx.tx_listenfd = bind_port(port, SOCK_STREAM);
+	if (ctx.tx_listenfd == -1 || listen(ctx.tx_listenfd, -1)) {
+		perror("[-] service port");
+		return (1);
+	}
+
+	ctx.tx_udpfd = bind_port(port, SOCK_DGRAM);
+	if (ctx.tx_udpfd == -1) {
+		perror("[-] UDP port");
+		return (1);
+	}
+
+	ctx.tx_conns = calloc(TARGET_MAXCONNS, sizeof(*ctx.tx_conns));
+	ctx.tx_dgrams = calloc(TARGET_MAXDGRAMS, sizeof(*ctx.tx_dgrams));
+	pfds = calloc(TARGET_MAXCONNS + 2, sizeof(*pfds));
+	if (ctx.tx_conns == NULL || ctx.tx_dgrams == NULL ||
+	    pfds == NULL) {
+		perror("calloc");
+		return (1);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+	signal(SIGUSR1, sighandler);
+#ifdef SIGINFO
+	signal(SIGINFO, sighandler);
+#endif
+
+	while (gotterm == 0) {
+		if (gotinfo) {
+			gotinfo = 0;
+			print_stats(&ctx);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		/* Sleep until the next delayed response is due. */
+		timeout = -1;
+		for (i = 0; i < ctx.tx_nconns; i++) {
+			if (ctx.tx_conns[i].tc_state != CONN_DELAYED) {
+				continue;
+			}
+			ms = ms_until(&now, &(ctx.tx_conns[i].tc_due));
+			if (timeout == -1 || ms < timeout) {
+				timeout = ms;
+			}
+		}
+		for (i = 0; i < ctx.tx_ndgrams; i++) {
+			ms = ms_until(&now, &(ctx.tx_dgrams[i].td_due));
+			if (timeout == -1 || ms < timeout) {
+				timeout = ms;
+			}
+		}
+
+		pfds[0].fd = ctx.tx_listenfd;
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+		pfds[1].fd = ctx.tx_udpfd;
+		pfds[1].events = POLLIN;
+		pfds[1].revents = 0;
+		npfds = 2;
+		for (i = 0; i < ctx.tx_nconns; i++) {
+			pfds[npfds].fd = ctx.tx_conns[i].tc_fd;
+			pfds[npfds].events =
+			    (ctx.tx_conns[i].tc_state == CONN_DELAYED) ?
+			    0 : POLLIN;
+			pfds[npfds].revents = 0;
+			npfds++;
+		}
+
+		if (poll(pfds, npfds, (int)timeout) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("[-] poll");
+			break;
+		}
+
+		/*
+		 * Handle existing connections first, back to front, so
+		 * that closing a connection (which moves the last one
+		 * into its slot) doesn't skip any.
+		 */
+		for (i = npfds - 2; i > 0; i--) {
+			if (pfds[i + 1].revents & (POLLIN | POLLHUP)) {
+				handle_conn(&ctx, i - 1);
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		run_timers(&ctx, &now);
+
+		if (pfds[0].revents & POLLIN) {
+			accept_conns(&ctx);
+		}
+
+		if (pfds[1].revents & POLLIN) {
+			handle_udp(&ctx);
+		}
+	}
+
+	print_stats(&ctx);
+
+	return (0);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: hbsdmon-target -p port [-l latency_ms] "
+	    "[-j jitter_ms]\n"
+	    "                      [-r reset_pct] [-s stall_pct] "
+	    "[-d drop_pct]\n"
+	    "                      [-R refuse_port] [-B blackhole_port]\n");
+	exit(1);
+}
+
+static void
+sighandler(int signo)
+{
+
+	switch (signo) {
+	case SIGINT:
+	case SIGTERM:
+		gotterm = 1;
+		break;
+	default:
+		gotinfo = 1;
+		break;
+	}
+}
+
+static int
+bind_port(int port, int type)
+{
+	struct sockaddr_in sin;
+	int fd, one;
+
+	fd = socket(PF_INET, type | SOCK_NONBLOCK, 0);
+	if (fd == -1) {
+		return (-1);
+	}
+
+	one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin))) {
+		close(fd);
+		return (-1);
+	}
+
+	return (fd);
+}
+
+static bool
+chance(unsigned int pct)
+{
+
+	if (pct == 0) {
+		return (false);
+	}
+
+	return (arc4random_uniform(100) < pct);
+}
+
+/*
+ * Compute when a delayed response is due: now + latency +/- jitter.
+ */
+static void
+schedule(target_ctx_t *ctx, struct timespec *due)
+{
+	long delay;
+
+	clock_gettime(CLOCK_MONOTONIC, due);
+
+	delay = ctx->tx_latency;
+	if (ctx->tx_jitter > 0) {
+		delay += (long)arc4random_uniform(
+		    (uint32_t)(ctx->tx_jitter * 2 + 1)) - ctx->tx_jitter;
+	}
+	if (delay <= 0) {
+		return;
+	}
+
+	due->tv_sec += delay / 1000;
+	due->tv_nsec += (delay % 1000) * 1000000;
+	if (due->tv_nsec >= 1000000000) {
+		due->tv_sec++;
+		due->tv_nsec -= 1000000000;
+	}
+}
+
+static long
+ms_until(const struct timespec *now, const struct timespec *due)
+{
+	long ms;
+
+	ms = (due->tv_sec - now->tv_sec) * 1000 +
+	    (due->tv_nsec - now->tv_nsec) / 1000000;
+
+	return (ms > 0 ? ms : 0);
+}
+
+static void
+accept_conns(target_ctx_t *ctx)
+{
+	struct linger linger;
+	target_conn_t *conn;
+	int fd;
+
+	while (ctx->tx_nconns < TARGET_MAXCONNS) {
+		fd = accept4(ctx->tx_listenfd, NULL, NULL, SOCK_NONBLOCK);
+		if (fd == -1) {
+			return;
+		}
+
+		ctx->tx_stats.ts_naccepted++;
+
+		if (chance(ctx->tx_resetpct)) {
+			/* Close with an RST instead of a FIN. */
+			linger.l_onoff = 1;
+			linger.l_linger = 0;
+			setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger,
+			    sizeof(linger));
+			close(fd);
+			ctx->tx_stats.ts_nreset++;
+			continue;
+		}
+
+		conn = &(ctx->tx_conns[ctx->tx_nconns++]);
+		memset(conn, 0, sizeof(*conn));
+		conn->tc_fd = fd;
+		conn->tc_state = CONN_READING;
+		if (chance(ctx->tx_stallpct)) {
+			conn->tc_state = CONN_STALLED;
+			ctx->tx_stats.ts_nstalled++;
+		}
+	}
+}
+
+static void
+handle_conn(target_ctx_t *ctx, size_t idx)
+{
+	target_conn_t *conn;
+	char buf[1024];
+	ssize_t i, len;
+
+	conn = &(ctx->tx_conns[idx]);
+
+	len = read(conn->tc_fd, buf, sizeof(buf));
+	if (len == 0 || (len == -1 && errno != EAGAIN)) {
+		/* Peer is done. TCP probes close right after connect. */
+		close_conn(ctx, idx);
+		return;
+	}
+
+	if (len <= 0 || conn->tc_state != CONN_READING) {
+		/* Stalled connections swallow everything. */
+		return;
+	}
+
+	/* Respond once the end of the request headers shows up. */
+	for (i = 0; i < len; i++) {
+		conn->tc_match = (conn->tc_match << 8) |
+		    (unsigned char)buf[i];
+		if (conn->tc_match == 0x0d0a0d0a) {
+			conn->tc_state = CONN_DELAYED;
+			schedule(ctx, &(conn->tc_due));
+			return;
+		}
+	}
+}
+
+static void
+close_conn(target_ctx_t *ctx, size_t idx)
+{
+
+	close(ctx->tx_conns[idx].tc_fd);
+	ctx->tx_conns[idx] = ctx->tx_conns[--ctx->tx_nconns];
+}
+
+static void
+handle_udp(target_ctx_t *ctx)
+{
+	target_dgram_t *dgram;
+	ssize_t len;
+
+	while (ctx->tx_ndgrams < TARGET_MAXDGRAMS) {
+		dgram = &(ctx->tx_dgrams[ctx->tx_ndgrams]);
+		dgram->td_addrlen = sizeof(dgram->td_addr);
+		len = recvfrom(ctx->tx_udpfd, dgram->td_buf,
+		    sizeof(dgram->td_buf), MSG_DONTWAIT,
+		    (struct sockaddr *)&(dgram->td_addr),
+		    &(dgram->td_addrlen));
+		if (len == -1) {
+			return;
+		}
+
+		ctx->tx_stats.ts_ndgrams++;
+		if (chance(ctx->tx_droppct)) {
+			ctx->tx_stats.ts_ndropped++;
+			continue;
+		}
+
+		dgram->td_len = (size_t)len;
+		schedule(ctx, &(dgram->td_due));
+		ctx->tx_ndgrams++;
+	}
+}
+
+static void
+run_timers(target_ctx_t *ctx, const struct timespec *now)
+{
+	target_dgram_t *dgram;
+	target_conn_t *conn;
+	size_t i;
+
+	for (i = ctx->tx_nconns; i > 0; i--) {
+		conn = &(ctx->tx_conns[i - 1]);
+		if (conn->tc_state != CONN_DELAYED ||
+		    ms_until(now, &(conn->tc_due)) > 0) {
+			continue;
+		}
+
+		write(conn->tc_fd, HTTP_RESPONSE, sizeof(HTTP_RESPONSE) - 1);
+		ctx->tx_stats.ts_nresponded++;
+		close_conn(ctx, i - 1);
+	}
+
+	for (i = ctx->tx_ndgrams; i > 0; i--) {
+		dgram = &(ctx->tx_dgrams[i - 1]);
+		if (ms_until(now, &(dgram->td_due)) > 0) {
+			continue;
+		}
+
+		sendto(ctx->tx_udpfd, dgram->td_buf, dgram->td_len, 0,
+		    (struct sockaddr *)&(dgram->td_addr),
+		    dgram->td_addrlen);
+		ctx->tx_dgrams[i - 1] = ctx->tx_dgrams[--ctx->tx_ndgrams];
+	}
+}
+
+static void
+print_stats(target_ctx_t *ctx)
+{
+
+	fprintf(stderr, "[*] hbsdmon-target: accepted=%ju reset=%ju "
+	    "stalled=%ju responded=%ju dgrams=%ju dropped=%ju open=%zu\n",
+	    (uintmax_t)ctx->tx_stats.ts_naccepted,
+	    (uintmax_t)ctx->tx_stats.ts_nreset,
+	    (uintmax_t)ctx->tx_stats.ts_nstalled,
+	    (uintmax_t)ctx->tx_stats.ts_nresponded,
+	    (uintmax_t)ctx->tx_stats.ts_ndgrams,
+	    (uintmax_t)ctx->tx_stats.ts_ndropped,
+	    ctx->tx_nconns);
+}
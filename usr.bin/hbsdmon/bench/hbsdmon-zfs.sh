@@ -0,0 +1,167 @@
+#!/bin/sh -
+#
+# Copyright (c) 2026 Shawn Webb <shawn.webb@hardenedbsd.org>
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Loopback test of ZFS monitoring against the mock backend, so it
+# runs without real pools. Starts a dry (-n) instance with many ZFS
+# nodes spread over a few mock pools, then degrades the first pool
+# and fills the second one past its nodes' capacity threshold. Every
+# node watching those pools must alert, exactly once, and the pools
+# must have been refreshed in shared passes rather than once per
+# probe.
+#
+# With -e, the instance gets fake ZFS events through a FIFO instead,
+# and its interval is an hour. The pool changes are followed by
+# events, and the nodes must alert on those without waiting for a
+# scheduled probe.
+#
+# Usually run through `make zfs ZFS_ARGS="..."`.
+#
+
+usage()
+{
+	cat 1>&2 <<USAGE
+usage: hbsdmon-zfs.sh -H hbsdmon [-n nodes] [-p pools] [-i interval] [-e]
+           [-k]
+USAGE
+	exit 1
+}
+
+hbsdmon=""
+nodes=50
+pools=5
+interval=2
+events=0
+keep=0
+
+while getopts "eH:i:kn:p:" o; do
+	case "${o}" in
+	e) events=1 ;;
+	H) hbsdmon=${OPTARG} ;;
+	i) interval=${OPTARG} ;;
+	k) keep=1 ;;
+	n) nodes=${OPTARG} ;;
+	p) pools=${OPTARG} ;;
+	*) usage ;;
+	esac
+done
+
+if [ -z "${hbsdmon}" -o ${pools} -lt 2 -o ${nodes} -lt ${pools} ]; then
+	usage
+fi
+
+workdir=$(mktemp -d -t hbsdmon-zfs) || exit 1
+pid=""
+
+cleanup()
+{
+	[ -n "${pid}" ] && kill -TERM ${pid} 2> /dev/null
+	wait ${pid} 2> /dev/null
+	if [ ${keep} -eq 0 ]; then
+		rm -rf ${workdir}
+	else
+		echo "Work directory: ${workdir}"
+	fi
+}
+trap cleanup EXIT INT TERM
+
+# Write the mock pool states. The first pool gets the given state,
+# the second one the given capacity.
+mkpools()
+{
+	awk -v pools=${pools} -v state=$1 -v capacity=$2 'BEGIN {
+		for (j = 0; j < pools; j++)
+			printf("pool%d: { state: \"%s\", capacity: %d, " \
+			    "vdevs: { da%d: { checksum: 0 } } },\n", j,
+			    j == 0 ? state : "ONLINE",
+			    j == 1 ? capacity : 50, j);
+	}' > ${workdir}/pools.conf.tmp
+	mv ${workdir}/pools.conf.tmp ${workdir}/pools.conf
+}
+
+mkpools ONLINE 50
+
+probeinterval=${interval}
+mockevents=""
+if [ ${events} -eq 1 ]; then
+	probeinterval=3600
+	mockevents=${workdir}/events
+	mkfifo ${mockevents} || exit 1
+fi
+
+awk -v nodes=${nodes} -v pools=${pools} -v interval=${probeinterval} \
+    -v mock=${workdir}/pools.conf -v mockevents="${mockevents}" 'BEGIN {
+	printf("{\n\tname: \"hbsdmon-zfs\",\n");
+	printf("\ttoken: \"test\",\n\tdest: \"test\",\n");
+	printf("\tinterval: %d,\n", interval);
+	printf("\tinterval_min: %d,\n", interval);
+	printf("\tinterval_max: %d,\n", interval);
+	printf("\theartbeat: 86400,\n");
+	printf("\tzfs: {\n\t\tbackend: \"mock\",\n");
+	printf("\t\tmock: \"%s\",\n", mock);
+	if (mockevents != "")
+		printf("\t\tmock_events: \"%s\",\n", mockevents);
+	printf("\t},\n");
+	printf("\tnodes: [\n");
+	for (j = 0; j < nodes; j++)
+		printf("\t\t{ host: \"localhost\", method: \"ZFS\", " \
+		    "pool: \"pool%d\", " \
+		    "thresholds: { capacity: 90 } },\n", j % pools);
+	printf("\t]\n}\n");
+}' > ${workdir}/hbsdmon.conf
+
+${hbsdmon} -n -c ${workdir}/hbsdmon.conf > /dev/null \
+    2> ${workdir}/hbsdmon.log &
+pid=$!
+
+sleep $((interval * 2 + 1))
+mkpools DEGRADED 95
+if [ ${events} -eq 1 ]; then
+	printf "resource.fs.zfs.statechange pool0 da0\n" > ${mockevents}
+	printf "ereport.fs.zfs.io pool1 da1\n" > ${mockevents}
+	sleep 2
+else
+	sleep $((interval * 3))
+fi
+
+kill -INFO ${pid}
+sleep 1
+
+expected=$(( (nodes + pools - 1) / pools + (nodes + pools - 2) / pools ))
+failures=$(grep -c '^NODE FAILURE:' ${workdir}/hbsdmon.log)
+probes=$(grep '^Probes:' ${workdir}/hbsdmon.log | tail -n 1 | \
+    awk '{ print $2 }')
+refreshes=$(grep '^ZFS refreshes:' ${workdir}/hbsdmon.log | tail -n 1 | \
+    awk '{ print $3 }')
+
+echo "${failures} failure alerts for ${expected} nodes on the degraded" \
+    "and full pools, ${refreshes:-0} refreshes for ${probes:-0} probes"
+
+if [ ${failures} -eq ${expected} -a ${refreshes:-0} -gt 0 -a \
+    ${refreshes:-0} -lt ${probes:-0} ]; then
+	echo "PASS"
+	exit 0
+fi
+echo "FAIL"
+exit 1
@@ -0,0 +1,727 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hbsdmon.h"
+
+#define	HBSDMON_CLUSTER_VERSION	2
+
+typedef enum _hbsdmon_cluster_msg_type {
+	CMSG_HEARTBEAT,
+	CMSG_STATE,
+	CMSG_CONFIRM_REQ,
+	CMSG_VERDICT,
+} hbsdmon_cluster_msg_type_t;
+
+/*
+ * What instances publish to each other. Peers are expected to run
+ * the same build.
+ */
+typedef struct _hbsdmon_cluster_msg {
+	uint32_t			 hcm_version;
+	uint32_t			 hcm_type;
+	char				 hcm_from[HBSDMON_CLUSTER_IDLEN];
+	char				 hcm_to[HBSDMON_CLUSTER_IDLEN];
+	char				 hcm_node[HBSDMON_CLUSTER_KEYLEN];
+	int64_t				 hcm_lastfail;
+	uint64_t			 hcm_seq;
+	uint32_t			 hcm_down;
+} hbsdmon_cluster_msg_t;
+
+static bool hbsdmon_cluster_node_key(hbsdmon_node_t *);
+static uint32_t hbsdmon_cluster_hash(const char *);
+static void hbsdmon_cluster_send(hbsdmon_cluster_t *,
+    hbsdmon_cluster_msg_t *);
+static hbsdmon_member_t *hbsdmon_cluster_member(hbsdmon_cluster_t *,
+    const char *);
+static void hbsdmon_cluster_rebalance(hbsdmon_ctx_t *);
+static void hbsdmon_cluster_ring_add(hbsdmon_cluster_t *,
+    hbsdmon_vnode_t *, hbsdmon_member_t *);
+static hbsdmon_member_t *hbsdmon_cluster_owner(hbsdmon_cluster_t *,
+    uint32_t);
+static void hbsdmon_cluster_republish(hbsdmon_ctx_t *);
+static hbsdmon_node_t *hbsdmon_cluster_find_node(hbsdmon_ctx_t *,
+    const char *);
+static int hbsdmon_cluster_vnode_cmp(const void *, const void *);
+static void hbsdmon_cluster_vote(hbsdmon_ctx_t *, hbsdmon_node_t *,
+    bool);
+static void hbsdmon_cluster_decide(hbsdmon_ctx_t *, hbsdmon_node_t *,
+    bool);
+
+/*
+ * Set up the cluster sockets and hash every node's identity. Nodes
+ * aren't owned by anyone until the membership had one timeout to
+ * settle, so a starting instance doesn't probe (and alert on) nodes
+ * a running peer already owns. ZFS nodes describe local pools and
+ * are never shared.
+ */
+bool
+hbsdmon_cluster_init(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_node_t *node, *tnode;
+	hbsdmon_cluster_t *cluster;
+	int linger;
+	size_t i;
+
+	cluster = ctx->hc_cluster;
+	if (cluster == NULL) {
+		return (true);
+	}
+
+	strlcpy(cluster->hcl_self.hm_id, cluster->hcl_id,
+	    sizeof(cluster->hcl_self.hm_id));
+	cluster->hcl_self.hm_alive = true;
+	cluster->hcl_nalive = 1;
+
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (!hbsdmon_cluster_node_key(node)) {
+			return (false);
+		}
+		node->hn_owned = node->hn_assigned =
+		    (node->hn_method == METHOD_ZFS);
+	}
+
+	cluster->hcl_pub = zmq_socket(ctx->hc_zmq, ZMQ_PUB);
+	cluster->hcl_sub = zmq_socket(ctx->hc_zmq, ZMQ_SUB);
+	if (cluster->hcl_pub == NULL || cluster->hcl_sub == NULL) {
+		fprintf(stderr, "[-] Unable to create cluster sockets.\n");
+		return (false);
+	}
+
+	/* Don't hold up exit on unsent heartbeats. */
+	linger = 0;
+	zmq_setsockopt(cluster->hcl_pub, ZMQ_LINGER, &linger,
+	    sizeof(linger));
+	zmq_setsockopt(cluster->hcl_sub, ZMQ_LINGER, &linger,
+	    sizeof(linger));
+
+	if (zmq_bind(cluster->hcl_pub, cluster->hcl_bind)) {
+		fprintf(stderr, "[-] Unable to bind cluster socket to %s:"
+		    " %s\n", cluster->hcl_bind, zmq_strerror(errno));
+		return (false);
+	}
+
+	zmq_setsockopt(cluster->hcl_sub, ZMQ_SUBSCRIBE, "", 0);
+	for (i = 0; i < cluster->hcl_npeers; i++) {
+		if (zmq_connect(cluster->hcl_sub, cluster->hcl_peers[i])) {
+			fprintf(stderr, "[-] Unable to connect to cluster"
+			    " peer %s: %s\n", cluster->hcl_peers[i],
+			    zmq_strerror(errno));
+			return (false);
+		}
+	}
+
+	cluster->hcl_start = hbsdmon_now_ms();
+
+	return (true);
+}
+
+void
+hbsdmon_cluster_fini(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_cluster_t *cluster;
+
+	cluster = ctx->hc_cluster;
+	if (cluster == NULL) {
+		return;
+	}
+
+	zmq_close(cluster->hcl_pub);
+	zmq_close(cluster->hcl_sub);
+	cluster->hcl_pub = cluster->hcl_sub = NULL;
+}
+
+void *
+hbsdmon_cluster_socket(hbsdmon_ctx_t *ctx)
+{
+
+	if (ctx->hc_cluster == NULL) {
+		return (NULL);
+	}
+
+	return (ctx->hc_cluster->hcl_sub);
+}
+
+/*
+ * Called from every main loop iteration: send our heartbeat when
+ * it's due, and drop peers we haven't heard from in a while.
+ */
+void
+hbsdmon_cluster_tick(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_member_t *member, *tmember;
+	hbsdmon_node_t *node, *tnode;
+	hbsdmon_cluster_t *cluster;
+	hbsdmon_cluster_msg_t msg;
+	bool changed;
+	uint64_t now;
+
+	cluster = ctx->hc_cluster;
+	if (cluster == NULL) {
+		return;
+	}
+
+	now = hbsdmon_now_ms();
+	changed = false;
+
+	if (now - cluster->hcl_lasthb >= HBSDMON_CLUSTER_HB_MS) {
+		memset(&msg, 0, sizeof(msg));
+		msg.hcm_type = CMSG_HEARTBEAT;
+		hbsdmon_cluster_send(cluster, &msg);
+		cluster->hcl_lasthb = now;
+	}
+
+	SLIST_FOREACH_SAFE(member, &(cluster->hcl_members), hm_entry,
+	    tmember) {
+		if (member->hm_alive &&
+		    now - member->hm_lastseen >= cluster->hcl_timeout * 1000) {
+			fprintf(stderr, "[*] Cluster: lost %s.\n",
+			    member->hm_id);
+			member->hm_alive = false;
+			changed = true;
+		}
+	}
+
+	if (cluster->hcl_settled == false &&
+	    now - cluster->hcl_start >= cluster->hcl_timeout * 1000) {
+		cluster->hcl_settled = true;
+		changed = true;
+	}
+
+	if (changed && cluster->hcl_settled) {
+		hbsdmon_cluster_rebalance(ctx);
+	}
+
+	if (cluster->hcl_npending > 0) {
+		SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry,
+		    tnode) {
+			if (node->hn_confirm.hcf_seq != 0 &&
+			    now - node->hn_confirm.hcf_start >=
+			    HBSDMON_CONFIRM_TIMEOUT_MS) {
+				hbsdmon_cluster_vote(ctx, node, true);
+			}
+		}
+	}
+}
+
+/*
+ * Handle everything our peers published since the last call.
+ */
+void
+hbsdmon_cluster_recv(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_cluster_t *cluster;
+	hbsdmon_cluster_msg_t msg;
+	hbsdmon_member_t *member;
+	hbsdmon_node_t *node;
+	bool joined;
+
+	cluster = ctx->hc_cluster;
+	if (cluster == NULL) {
+		return;
+	}
+
+	joined = false;
+	while (zmq_recv(cluster->hcl_sub, &msg, sizeof(msg),
+	    ZMQ_DONTWAIT) == sizeof(msg)) {
+		if (msg.hcm_version != HBSDMON_CLUSTER_VERSION) {
+			continue;
+		}
+		msg.hcm_from[sizeof(msg.hcm_from) - 1] = '\0';
+		msg.hcm_to[sizeof(msg.hcm_to) - 1] = '\0';
+		msg.hcm_node[sizeof(msg.hcm_node) - 1] = '\0';
+
+		member = hbsdmon_cluster_member(cluster, msg.hcm_from);
+		if (member == NULL) {
+			continue;
+		}
+		member->hm_lastseen = hbsdmon_now_ms();
+		if (member->hm_alive == false) {
+			fprintf(stderr, "[*] Cluster: %s joined.\n",
+			    member->hm_id);
+			member->hm_alive = true;
+			joined = true;
+		}
+
+		switch (msg.hcm_type) {
+		case CMSG_STATE:
+			node = hbsdmon_cluster_find_node(ctx, msg.hcm_node);
+			if (node == NULL) {
+				break;
+			}
+			node->hn_shared_lastfail = (time_t)msg.hcm_lastfail;
+			hbsdmon_node_tell(node, VERB_STATE,
+			    (uint64_t)msg.hcm_lastfail, 0);
+			hbsdmon_deps_update(ctx, node);
+			break;
+		case CMSG_CONFIRM_REQ:
+			node = hbsdmon_cluster_find_node(ctx, msg.hcm_node);
+			if (node == NULL) {
+				break;
+			}
+			strlcpy(node->hn_confirm.hcf_to, msg.hcm_from,
+			    sizeof(node->hn_confirm.hcf_to));
+			node->hn_confirm.hcf_reqseq = msg.hcm_seq;
+			hbsdmon_node_tell(node, VERB_CONFIRM, msg.hcm_seq, 0);
+			break;
+		case CMSG_VERDICT:
+			if (strcmp(msg.hcm_to, cluster->hcl_id) != 0) {
+				break;
+			}
+			node = hbsdmon_cluster_find_node(ctx, msg.hcm_node);
+			if (node == NULL ||
+			    node->hn_confirm.hcf_seq != msg.hcm_seq) {
+				/* Decided already. */
+				break;
+			}
+			if (msg.hcm_down) {
+				node->hn_confirm.hcf_ndown++;
+			} else {
+				node->hn_confirm.hcf_nup++;
+			}
+			hbsdmon_cluster_vote(ctx, node, false);
+			break;
+		case CMSG_HEARTBEAT:
+		default:
+			break;
+		}
+	}
+
+	if (joined && cluster->hcl_settled) {
+		hbsdmon_cluster_rebalance(ctx);
+		/* Bring the new member up to date. */
+		hbsdmon_cluster_republish(ctx);
+	}
+}
+
+/*
+ * A node thread changed its node's alert state. Replicate it, so
+ * that whoever owns the node next doesn't alert again.
+ */
+void
+hbsdmon_cluster_publish_state(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node,
+    time_t lastfail)
+{
+	hbsdmon_cluster_msg_t msg;
+
+	if (ctx->hc_cluster == NULL) {
+		return;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.hcm_type = CMSG_STATE;
+	strlcpy(msg.hcm_node, node->hn_key, sizeof(msg.hcm_node));
+	msg.hcm_lastfail = (int64_t)lastfail;
+	hbsdmon_cluster_send(ctx->hc_cluster, &msg);
+}
+
+/*
+ * A node thread saw its node fail. Ask every peer to probe it too.
+ * Our own probe counts as the first vote.
+ */
+void
+hbsdmon_cluster_suspect(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node)
+{
+	hbsdmon_cluster_t *cluster;
+	hbsdmon_cluster_msg_t msg;
+
+	cluster = ctx->hc_cluster;
+	if (cluster == NULL || node->hn_confirm.hcf_seq != 0) {
+		return;
+	}
+
+	node->hn_confirm.hcf_seq = ++(cluster->hcl_seq);
+	node->hn_confirm.hcf_start = hbsdmon_now_ms();
+	node->hn_confirm.hcf_ndown = 1;
+	node->hn_confirm.hcf_nup = 0;
+	cluster->hcl_npending++;
+
+	hbsdmon_lock_ctx(ctx);
+	ctx->hc_stats.hs_nconfirms++;
+	hbsdmon_unlock_ctx(ctx);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.hcm_type = CMSG_CONFIRM_REQ;
+	strlcpy(msg.hcm_node, node->hn_key, sizeof(msg.hcm_node));
+	msg.hcm_seq = node->hn_confirm.hcf_seq;
+	hbsdmon_cluster_send(cluster, &msg);
+
+	/* We may be alone. */
+	hbsdmon_cluster_vote(ctx, node, false);
+}
+
+/*
+ * A node thread probed its node because a peer asked. Send the
+ * verdict to that peer.
+ */
+void
+hbsdmon_cluster_verdict(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node,
+    uint64_t seq, bool down)
+{
+	hbsdmon_cluster_msg_t msg;
+
+	if (ctx->hc_cluster == NULL || node->hn_confirm.hcf_reqseq != seq) {
+		return;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.hcm_type = CMSG_VERDICT;
+	strlcpy(msg.hcm_to, node->hn_confirm.hcf_to, sizeof(msg.hcm_to));
+	strlcpy(msg.hcm_node, node->hn_key, sizeof(msg.hcm_node));
+	msg.hcm_seq = seq;
+	msg.hcm_down = down;
+	hbsdmon_cluster_send(ctx->hc_cluster, &msg);
+}
+
+/*
+ * Decide a confirmation once the votes allow it. The quorum can't
+ * exceed the number of live members. Once it times out, the peers
+ * that answered decide by majority, and a tie alerts: a false alert
+ * is cheaper than a missed outage.
+ */
+static void
+hbsdmon_cluster_vote(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node,
+    bool timedout)
+{
+	hbsdmon_cluster_t *cluster;
+	hbsdmon_confirm_t *cf;
+	size_t quorum;
+
+	cluster = ctx->hc_cluster;
+	cf = &(node->hn_confirm);
+
+	quorum = cluster->hcl_quorum;
+	if (quorum > cluster->hcl_nalive) {
+		quorum = cluster->hcl_nalive;
+	}
+
+	if (cf->hcf_ndown >= quorum) {
+		hbsdmon_cluster_decide(ctx, node, true);
+	} else if (cf->hcf_nup > cluster->hcl_nalive - quorum) {
+		hbsdmon_cluster_decide(ctx, node, false);
+	} else if (timedout) {
+		hbsdmon_cluster_decide(ctx, node,
+		    cf->hcf_ndown >= cf->hcf_nup);
+	}
+}
+
+static void
+hbsdmon_cluster_decide(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node,
+    bool down)
+{
+
+	node->hn_confirm.hcf_seq = 0;
+	ctx->hc_cluster->hcl_npending--;
+
+	hbsdmon_lock_ctx(ctx);
+	if (down) {
+		ctx->hc_stats.hs_nconfirmed++;
+	} else {
+		ctx->hc_stats.hs_nrefuted++;
+	}
+	hbsdmon_unlock_ctx(ctx);
+
+	if (down == false) {
+		fprintf(stderr, "[*] Cluster: peers refuted the failure"
+		    " of %s.\n", node->hn_key);
+	}
+
+	hbsdmon_node_tell(node, VERB_VERDICT, down, 0);
+}
+
+static void
+hbsdmon_cluster_send(hbsdmon_cluster_t *cluster,
+    hbsdmon_cluster_msg_t *msg)
+{
+
+	msg->hcm_version = HBSDMON_CLUSTER_VERSION;
+	strlcpy(msg->hcm_from, cluster->hcl_id, sizeof(msg->hcm_from));
+	zmq_send(cluster->hcl_pub, msg, sizeof(*msg), ZMQ_DONTWAIT);
+}
+
+/*
+ * Pass a message on to a node's thread, if it's running.
+ */
+static void
+hbsdmon_cluster_republish(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_node_t *node, *tnode;
+
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_assigned && node->hn_shared_lastfail != 0) {
+			hbsdmon_cluster_publish_state(ctx, node,
+			    node->hn_shared_lastfail);
+		}
+	}
+}
+
+static hbsdmon_member_t *
+hbsdmon_cluster_member(hbsdmon_cluster_t *cluster, const char *id)
+{
+	hbsdmon_member_t *member, *tmember;
+
+	SLIST_FOREACH_SAFE(member, &(cluster->hcl_members), hm_entry,
+	    tmember) {
+		if (strcmp(member->hm_id, id) == 0) {
+			return (member);
+		}
+	}
+
+	member = calloc(1, sizeof(*member));
+	if (member == NULL) {
+		return (NULL);
+	}
+
+	strlcpy(member->hm_id, id, sizeof(member->hm_id));
+	SLIST_INSERT_HEAD(&(cluster->hcl_members), member, hm_entry);
+
+	return (member);
+}
+
+/*
+ * Rebuild the hash ring from the live members, ourselves included,
+ * and tell every node thread whose ownership changed. Only the
+ * nodes of a member that left or joined move.
+ */
+static void
+hbsdmon_cluster_rebalance(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_member_t *member, *tmember, *owner;
+	hbsdmon_node_t *node, *tnode;
+	hbsdmon_cluster_t *cluster;
+	hbsdmon_vnode_t *ring;
+	size_t nalive;
+	bool owned;
+
+	cluster = ctx->hc_cluster;
+
+	nalive = 1;
+	SLIST_FOREACH_SAFE(member, &(cluster->hcl_members), hm_entry,
+	    tmember) {
+		if (member->hm_alive) {
+			nalive++;
+		}
+	}
+
+	ring = calloc(nalive * HBSDMON_CLUSTER_VNODES, sizeof(*ring));
+	if (ring == NULL) {
+		fprintf(stderr, "[-] Cluster: unable to rebuild the hash"
+		    " ring. Keeping the old one.\n");
+		return;
+	}
+
+	cluster->hcl_nvnodes = 0;
+	hbsdmon_cluster_ring_add(cluster, ring, &(cluster->hcl_self));
+	SLIST_FOREACH_SAFE(member, &(cluster->hcl_members), hm_entry,
+	    tmember) {
+		if (member->hm_alive) {
+			hbsdmon_cluster_ring_add(cluster, ring, member);
+		}
+	}
+
+	qsort(ring, cluster->hcl_nvnodes, sizeof(*ring),
+	    hbsdmon_cluster_vnode_cmp);
+
+	free(cluster->hcl_ring);
+	cluster->hcl_ring = ring;
+	cluster->hcl_nalive = nalive;
+	cluster->hcl_nowned = 0;
+
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		owner = hbsdmon_cluster_owner(cluster, node->hn_hash);
+		owned = (node->hn_method == METHOD_ZFS ||
+		    owner == &(cluster->hcl_self));
+		if (owned) {
+			cluster->hcl_nowned++;
+		}
+
+		if (owned == node->hn_assigned) {
+			continue;
+		}
+
+		node->hn_assigned = owned;
+		hbsdmon_node_tell(node, VERB_OWN, owned, 0);
+	}
+
+	fprintf(stderr, "[*] Cluster: %zu members. Owning %zu of %zu"
+	    " nodes.\n", nalive, cluster->hcl_nowned, ctx->hc_nnodes);
+}
+
+static void
+hbsdmon_cluster_ring_add(hbsdmon_cluster_t *cluster, hbsdmon_vnode_t *ring,
+    hbsdmon_member_t *member)
+{
+	char vname[HBSDMON_CLUSTER_IDLEN + 16];
+	size_t i;
+
+	for (i = 0; i < HBSDMON_CLUSTER_VNODES; i++) {
+		snprintf(vname, sizeof(vname), "%s#%zu", member->hm_id, i);
+		ring[cluster->hcl_nvnodes].hv_hash =
+		    hbsdmon_cluster_hash(vname);
+		ring[cluster->hcl_nvnodes].hv_member = member;
+		cluster->hcl_nvnodes++;
+	}
+}
+
+static hbsdmon_member_t *
+hbsdmon_cluster_owner(hbsdmon_cluster_t *cluster, uint32_t hash)
+{
+	size_t lo, hi, mid;
+
+	if (cluster->hcl_nvnodes == 0) {
+		return (NULL);
+	}
+
+	/* The first vnode at or after the hash, wrapping around. */
+	lo = 0;
+	hi = cluster->hcl_nvnodes;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (cluster->hcl_ring[mid].hv_hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo == cluster->hcl_nvnodes) {
+		lo = 0;
+	}
+
+	return (cluster->hcl_ring[lo].hv_member);
+}
+
+/*
+ * A node is identified across instances by its method, host and
+ * port (or pool).
+ */
+static bool
+hbsdmon_cluster_node_key(hbsdmon_node_t *node)
+{
+	char desc[HBSDMON_CLUSTER_KEYLEN], key[HBSDMON_CLUSTER_KEYLEN];
+	hbsdmon_keyvalue_t *kv;
+
+	switch (node->hn_method) {
+	case METHOD_TCP:
+	case METHOD_UDP:
+		kv = hbsdmon_find_kv_in_node(node, "port", false);
+		snprintf(key, sizeof(key), "%s/%s/%d",
+		    hbsdmon_node_method(node), node->hn_host,
+		    kv != NULL ? hbsdmon_keyvalue_to_int(kv) : 0);
+		break;
+	case METHOD_ZFS:
+		kv = hbsdmon_find_kv_in_node(node, "pool", false);
+		snprintf(key, sizeof(key), "%s/%s/%s",
+		    hbsdmon_node_method(node), node->hn_host,
+		    kv != NULL ? hbsdmon_keyvalue_to_str(kv) : "");
+		break;
+	case METHOD_EXEC:
+		kv = hbsdmon_find_kv_in_node(node, "command", false);
+		snprintf(key, sizeof(key), "%s/%s/%s",
+		    hbsdmon_node_method(node), node->hn_host,
+		    kv != NULL ? hbsdmon_keyvalue_to_str(kv) : "");
+		break;
+	case METHOD_PLUGIN:
+		if (hbsdmon_plugin_desc(node, desc, sizeof(desc)) < 0) {
+			desc[0] = '\0';
+		}
+		snprintf(key, sizeof(key), "%s/%s/%s",
+		    hbsdmon_node_method(node), node->hn_host, desc);
+		break;
+	default:
+		snprintf(key, sizeof(key), "%s/%s",
+		    hbsdmon_node_method(node), node->hn_host);
+		break;
+	}
+
+	node->hn_key = strdup(key);
+	if (node->hn_key == NULL) {
+		return (false);
+	}
+	node->hn_hash = hbsdmon_cluster_hash(key);
+
+	return (true);
+}
+
+static hbsdmon_node_t *
+hbsdmon_cluster_find_node(hbsdmon_ctx_t *ctx, const char *key)
+{
+	hbsdmon_node_t *node, *tnode;
+	uint32_t hash;
+
+	hash = hbsdmon_cluster_hash(key);
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_hash == hash && strcmp(node->hn_key, key) == 0) {
+			return (node);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * 32-bit FNV-1a, followed by a final mix so that keys differing only
+ * in their last characters (vnode numbers, ports) still land far
+ * apart on the ring.
+ */
+static uint32_t
+hbsdmon_cluster_hash(const char *str)
+{
+	uint32_t hash;
+
+	hash = 2166136261u;
+	while (*str != '\0') {
+		hash ^= (uint8_t)*str++;
+		hash *= 16777619u;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+
+	return (hash);
+}
+
+static int
+hbsdmon_cluster_vnode_cmp(const void *a, const void *b)
+{
+	const hbsdmon_vnode_t *va, *vb;
+
+	va = a;
+	vb = b;
+
+	if (va->hv_hash < vb->hv_hash) {
+		return (-1);
+	}
+	return (va->hv_hash > vb->hv_hash);
+}
@@ -24,6 +24,7 @@
  * SUCH DAMAGE.
  */
 
+#include <sys/param.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,6 +35,16 @@
 #include "hbsdmon.h"
 
 static bool parse_nodes(hbsdmon_ctx_t *, const ucl_object_t *);
+static bool parse_interval(hbsdmon_keyvalue_store_t *,
+    const ucl_object_t *, const char *);
+static bool parse_cluster(hbsdmon_ctx_t *, const ucl_object_t *);
+static bool parse_depends_on(hbsdmon_node_t *, const ucl_object_t *);
+static bool parse_zfs(hbsdmon_ctx_t *, const ucl_object_t *);
+static bool parse_zfs_limits(hbsdmon_node_t *, const ucl_object_t *);
+static bool parse_plugins(hbsdmon_ctx_t *, const ucl_object_t *);
+static bool parse_exec(hbsdmon_ctx_t *, const ucl_object_t *);
+static bool parse_exec_node(hbsdmon_ctx_t *, hbsdmon_node_t *,
+    const ucl_object_t *);
 
 hbsdmon_ctx_t *
 new_ctx(void)
@@ -60,6 +71,7 @@ new_ctx(void)
 
 	SLIST_INIT(&(ctx->hc_nodes));
 	SLIST_INIT(&(ctx->hc_threads));
+	SLIST_INIT(&(ctx->hc_plugins));
 
 	return (ctx);
 }
@@ -78,7 +90,6 @@ parse_config(hbsdmon_ctx_t *ctx)
 	const ucl_object_t *top, *obj;
 	struct ucl_parser *parser;
 	hbsdmon_keyvalue_t *kv;
-	uint64_t interval;
 	time_t hbtime;
 	const char *str;
 	int64_t ucl_int;
@@ -146,21 +157,26 @@ parse_config(hbsdmon_ctx_t *ctx)
 		goto end;
 	}
 
-	obj = ucl_lookup_path(top, ".interval");
+	obj = ucl_lookup_path(top, ".spool");
 	if (obj != NULL) {
-		ucl_int = ucl_object_toint(obj);
-		interval = (uint64_t)ucl_int;
-		kv = hbsdmon_new_keyvalue();
-		if (kv == NULL) {
+		str = ucl_object_tostring(obj);
+		if (str == NULL) {
+			fprintf(stderr, "[-] spool is not a string.\n");
 			res = false;
 			goto end;
 		}
-		res = hbsdmon_keyvalue_store(kv, "interval",
-		    &interval, sizeof(interval));
-		if (res == false) {
+		ctx->hc_spool = strdup(str);
+		if (ctx->hc_spool == NULL) {
+			res = false;
 			goto end;
 		}
-		hbsdmon_append_kv(ctx->hc_kvstore, kv);
+	}
+
+	if (!parse_interval(ctx->hc_kvstore, top, "interval") ||
+	    !parse_interval(ctx->hc_kvstore, top, "interval_min") ||
+	    !parse_interval(ctx->hc_kvstore, top, "interval_max")) {
+		res = false;
+		goto end;
 	}
 
 	/* Default the heartbeat to six hours. */
@@ -205,7 +221,26 @@ parse_config(hbsdmon_ctx_t *ctx)
 		}
 	}
 
-	res = parse_nodes(ctx, top);
+	res = parse_cluster(ctx, top);
+	if (res) {
+		res = parse_zfs(ctx, top);
+	}
+	if (res) {
+		res = parse_plugins(ctx, top);
+	}
+	if (res) {
+		res = parse_exec(ctx, top);
+	}
+	if (res) {
+		res = parse_nodes(ctx, top);
+	}
+	if (res) {
+		res = hbsdmon_deps_resolve(ctx);
+	}
+	if (res) {
+		/* Invalidate the nodes' cached descriptions. */
+		ctx->hc_generation++;
+	}
 
 end:
 	if (res == false) {
@@ -221,6 +256,7 @@ parse_nodes(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
 {
 	const ucl_object_t *ucl_nodes, *ucl_node, *ucl_tmp;
 	ucl_object_iter_t ucl_it, ucl_it_obj;
+	hbsdmon_plugin_mod_t *plugin;
 	hbsdmon_keyvalue_t *kv;
 	hbsdmon_node_t *node;
 	uint64_t kv_uint;
@@ -270,6 +306,33 @@ parse_nodes(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
 			return (false);
 		}
 
+		ucl_tmp = ucl_lookup_path(ucl_node, ".name");
+		if (ucl_tmp != NULL) {
+			str = ucl_object_tostring(ucl_tmp);
+			if (str == NULL) {
+				fprintf(stderr, "[-] Name of host %s is not"
+				    " a string.\n", node->hn_host);
+				return (false);
+			}
+			node->hn_name = strdup(str);
+			if (node->hn_name == NULL) {
+				return (false);
+			}
+		}
+
+		if (!parse_depends_on(node, ucl_node)) {
+			return (false);
+		}
+
+		/*
+		 * For testing quorum: this instance treats the node as
+		 * unreachable without probing it.
+		 */
+		ucl_tmp = ucl_lookup_path(ucl_node, ".simulate_unreachable");
+		if (ucl_tmp != NULL) {
+			node->hn_simfail = ucl_object_toboolean(ucl_tmp);
+		}
+
 		ucl_tmp = ucl_lookup_path(ucl_node, ".messages.fail");
 		if (ucl_tmp != NULL) {
 			str = ucl_object_tostring(ucl_tmp);
@@ -286,6 +349,7 @@ parse_nodes(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
 				return (false);
 			}
 			hbsdmon_node_append_kv(node, kv);
+			node->hn_failmsg = hbsdmon_keyvalue_to_str(kv);
 		}
 
 		ucl_tmp = ucl_lookup_path(ucl_node, ".method");
@@ -301,7 +365,16 @@ parse_nodes(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
 			return (false);
 		}
 
-		node->hn_method = hbsdmon_str_to_method(str);
+		plugin = hbsdmon_plugin_find(ctx, str);
+		if (plugin != NULL) {
+			if (!hbsdmon_plugin_add_node(plugin, node,
+			    ucl_node)) {
+				return (false);
+			}
+		} else {
+			node->hn_method = hbsdmon_str_to_method(str);
+		}
+
 		switch (node->hn_method) {
 		case METHOD_HTTP:
 		case METHOD_HTTPS:
@@ -356,24 +429,33 @@ parse_nodes(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
 				return (false);
 			}
 			hbsdmon_node_append_kv(node, kv);
-		default:
-			break;
-		}
 
-		ucl_tmp = ucl_lookup_path(top, ".interval");
-		if (ucl_tmp != NULL) {
-			ucl_int = ucl_object_toint(ucl_tmp);
-			kv_uint = (uint64_t)ucl_int;
-			kv = hbsdmon_new_keyvalue();
-			if (kv == NULL) {
+			if (!hbsdmon_zfs_add_pool(ctx, node, str)) {
 				return (false);
 			}
-			res = hbsdmon_keyvalue_store(kv, "interval",
-			    &kv_uint, sizeof(kv_uint));
-			if (res == false) {
+
+			if (!parse_zfs_limits(node, ucl_node)) {
 				return (false);
 			}
-			hbsdmon_node_append_kv(node, kv);
+			break;
+		case METHOD_EXEC:
+			if (!parse_exec_node(ctx, node, ucl_node)) {
+				return (false);
+			}
+			break;
+		default:
+			break;
+		}
+
+		if (!parse_interval(node->hn_kvstore, ucl_node,
+		    "interval") ||
+		    !parse_interval(node->hn_kvstore, ucl_node,
+		    "interval_min") ||
+		    !parse_interval(node->hn_kvstore, ucl_node,
+		    "interval_max")) {
+			fprintf(stderr, "[-] Invalid interval for host %s\n",
+			    node->hn_host);
+			return (false);
 		}
 
 		ucl_tmp = ucl_lookup_path(ucl_node, ".addrfam");
@@ -404,8 +486,528 @@ parse_nodes(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
 		}
 
 		SLIST_INSERT_HEAD(&(ctx->hc_nodes), node, hn_entry);
-		ctx->hc_nnodes++;
+		node->hn_index = ctx->hc_nnodes++;
+	}
+
+	return (true);
+}
+
+/*
+ * Parse an optional interval (in seconds) from obj and store it in
+ * the given keyvalue store. Intervals are looked up per-node first,
+ * then globally, by hbsdmon_get_interval() and friends.
+ */
+static bool
+parse_interval(hbsdmon_keyvalue_store_t *store, const ucl_object_t *obj,
+    const char *key)
+{
+	const ucl_object_t *ucl_tmp;
+	hbsdmon_keyvalue_t *kv;
+	char path[64];
+	uint64_t interval;
+	int64_t ucl_int;
+
+	snprintf(path, sizeof(path), ".%s", key);
+	ucl_tmp = ucl_lookup_path(obj, path);
+	if (ucl_tmp == NULL) {
+		return (true);
+	}
+
+	if (!ucl_object_toint_safe(ucl_tmp, &ucl_int) || ucl_int <= 0) {
+		fprintf(stderr, "[-] %s must be a positive integer.\n", key);
+		return (false);
+	}
+
+	interval = (uint64_t)ucl_int;
+	kv = hbsdmon_new_keyvalue();
+	if (kv == NULL) {
+		return (false);
+	}
+
+	if (!hbsdmon_keyvalue_store(kv, key, &interval,
+	    sizeof(interval))) {
+		free(kv);
+		return (false);
+	}
+
+	hbsdmon_append_kv(store, kv);
+	return (true);
+}
+
+/*
+ * Parse the optional cluster section:
+ *
+ * cluster {
+ *	id: "mon-a",			# Defaults to bind
+ *	bind: "tcp://192.0.2.1:7001",
+ *	peers: [ "tcp://192.0.2.2:7001", ... ],
+ *	timeout: 5,			# Seconds
+ *	quorum: 2,			# Votes needed to alert
+ * }
+ */
+static bool
+parse_cluster(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
+{
+	const ucl_object_t *ucl_cluster, *ucl_peers, *ucl_peer, *ucl_tmp;
+	hbsdmon_cluster_t *cluster;
+	ucl_object_iter_t ucl_it;
+	const char *str;
+	int64_t ucl_int;
+	size_t npeers;
+
+	ucl_cluster = ucl_lookup_path(top, ".cluster");
+	if (ucl_cluster == NULL) {
+		return (true);
+	}
+
+	cluster = calloc(1, sizeof(*cluster));
+	if (cluster == NULL) {
+		return (false);
+	}
+	SLIST_INIT(&(cluster->hcl_members));
+	cluster->hcl_timeout = HBSDMON_CLUSTER_TIMEOUT;
+	cluster->hcl_quorum = 1;
+	ctx->hc_cluster = cluster;
+
+	ucl_tmp = ucl_lookup_path(ucl_cluster, ".bind");
+	str = (ucl_tmp != NULL) ? ucl_object_tostring(ucl_tmp) : NULL;
+	if (str == NULL) {
+		fprintf(stderr, "[-] cluster.bind must be set.\n");
+		return (false);
+	}
+	cluster->hcl_bind = strdup(str);
+	if (cluster->hcl_bind == NULL) {
+		return (false);
+	}
+
+	ucl_tmp = ucl_lookup_path(ucl_cluster, ".id");
+	str = (ucl_tmp != NULL) ? ucl_object_tostring(ucl_tmp) :
+	    cluster->hcl_bind;
+	if (str == NULL || strlen(str) >= HBSDMON_CLUSTER_IDLEN) {
+		fprintf(stderr, "[-] cluster.id must be a string shorter"
+		    " than %d characters.\n", HBSDMON_CLUSTER_IDLEN);
+		return (false);
+	}
+	cluster->hcl_id = strdup(str);
+	if (cluster->hcl_id == NULL) {
+		return (false);
+	}
+
+	ucl_tmp = ucl_lookup_path(ucl_cluster, ".timeout");
+	if (ucl_tmp != NULL) {
+		if (!ucl_object_toint_safe(ucl_tmp, &ucl_int) ||
+		    ucl_int <= 0) {
+			fprintf(stderr, "[-] cluster.timeout must be a"
+			    " positive integer.\n");
+			return (false);
+		}
+		cluster->hcl_timeout = (uint64_t)ucl_int;
+	}
+
+	ucl_tmp = ucl_lookup_path(ucl_cluster, ".quorum");
+	if (ucl_tmp != NULL) {
+		if (!ucl_object_toint_safe(ucl_tmp, &ucl_int) ||
+		    ucl_int <= 0) {
+			fprintf(stderr, "[-] cluster.quorum must be a"
+			    " positive integer.\n");
+			return (false);
+		}
+		cluster->hcl_quorum = (size_t)ucl_int;
+	}
+
+	ucl_peers = ucl_lookup_path(ucl_cluster, ".peers");
+	if (ucl_peers == NULL) {
+		return (true);
+	}
+
+	npeers = 0;
+	ucl_it = NULL;
+	while (ucl_iterate_object(ucl_peers, &ucl_it, true) != NULL) {
+		npeers++;
+	}
+
+	cluster->hcl_peers = calloc(npeers, sizeof(char *));
+	if (cluster->hcl_peers == NULL && npeers > 0) {
+		return (false);
+	}
+
+	ucl_it = NULL;
+	while ((ucl_peer = ucl_iterate_object(ucl_peers, &ucl_it, true))) {
+		str = ucl_object_tostring(ucl_peer);
+		if (str == NULL) {
+			fprintf(stderr, "[-] cluster.peers must be a list"
+			    " of endpoints.\n");
+			return (false);
+		}
+		cluster->hcl_peers[cluster->hcl_npeers] = strdup(str);
+		if (cluster->hcl_peers[cluster->hcl_npeers] == NULL) {
+			return (false);
+		}
+		cluster->hcl_npeers++;
+	}
+
+	return (true);
+}
+
+/*
+ * Parse a node's depends_on: the name, or list of names, of the
+ * nodes it can only be reached through. Names are resolved once all
+ * nodes are parsed.
+ */
+static bool
+parse_depends_on(hbsdmon_node_t *node, const ucl_object_t *ucl_node)
+{
+	const ucl_object_t *ucl_deps, *ucl_dep;
+	ucl_object_iter_t ucl_it;
+	const char *str;
+	size_t ndeps;
+
+	ucl_deps = ucl_lookup_path(ucl_node, ".depends_on");
+	if (ucl_deps == NULL) {
+		return (true);
+	}
+
+	ndeps = 0;
+	ucl_it = NULL;
+	while (ucl_iterate_object(ucl_deps, &ucl_it, true) != NULL) {
+		ndeps++;
+	}
+
+	node->hn_depnames = calloc(ndeps, sizeof(char *));
+	if (node->hn_depnames == NULL && ndeps > 0) {
+		return (false);
+	}
+
+	ucl_it = NULL;
+	while ((ucl_dep = ucl_iterate_object(ucl_deps, &ucl_it, true))) {
+		str = ucl_object_tostring(ucl_dep);
+		if (str == NULL) {
+			fprintf(stderr, "[-] depends_on of host %s must"
+			    " name nodes.\n", node->hn_host);
+			return (false);
+		}
+		node->hn_depnames[node->hn_ndepnames] = strdup(str);
+		if (node->hn_depnames[node->hn_ndepnames] == NULL) {
+			return (false);
+		}
+		node->hn_ndepnames++;
+	}
+
+	return (true);
+}
+
+/*
+ * Load the probe plugins listed in the optional plugins array:
+ *
+ * plugins: [ "/usr/local/lib/hbsdmon/connect.so" ]
+ *
+ * Nodes may then use the methods the plugins define.
+ */
+static bool
+parse_plugins(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
+{
+	const ucl_object_t *ucl_plugins, *ucl_plugin;
+	ucl_object_iter_t ucl_it;
+	const char *str;
+
+	ucl_plugins = ucl_lookup_path(top, ".plugins");
+	if (ucl_plugins == NULL) {
+		return (true);
+	}
+
+	ucl_it = NULL;
+	while ((ucl_plugin = ucl_iterate_object(ucl_plugins, &ucl_it,
+	    true))) {
+		str = ucl_object_tostring(ucl_plugin);
+		if (str == NULL) {
+			fprintf(stderr, "[-] plugins must be paths.\n");
+			return (false);
+		}
+		if (!hbsdmon_plugin_load(ctx, str)) {
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+/*
+ * Parse the optional EXEC section. Without it, EXEC nodes get the
+ * defaults:
+ *
+ * exec: {
+ *	workers: 4,		# Helper processes, and concurrent commands
+ *	timeout: 10,		# Seconds a command may run
+ *	cpu: 5,			# CPU seconds a command may use, 0 for any
+ *	output: 512,		# Bytes of output kept
+ * }
+ */
+static bool
+parse_exec(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
+{
+	static const char *names[] = {
+		"workers", "timeout", "cpu", "output",
+	};
+	const ucl_object_t *ucl_exec, *ucl_tmp;
+	int64_t ucl_int;
+	size_t i;
+
+	ucl_exec = ucl_lookup_path(top, ".exec");
+	if (ucl_exec == NULL) {
+		return (true);
+	}
+
+	ctx->hc_exec = hbsdmon_exec_new();
+	if (ctx->hc_exec == NULL) {
+		return (false);
+	}
+
+	for (i = 0; i < nitems(names); i++) {
+		ucl_tmp = ucl_object_lookup(ucl_exec, names[i]);
+		if (ucl_tmp == NULL) {
+			continue;
+		}
+		if (!ucl_object_toint_safe(ucl_tmp, &ucl_int) ||
+		    ucl_int < (i == 2 ? 0 : 1) ||
+		    ucl_int > (i == 3 ? 65536 : 3600)) {
+			fprintf(stderr, "[-] exec.%s is out of range.\n",
+			    names[i]);
+			return (false);
+		}
+		switch (i) {
+		case 0:
+			ctx->hc_exec->hx_nworkers = (size_t)ucl_int;
+			break;
+		case 1:
+			ctx->hc_exec->hx_timeout = (unsigned int)ucl_int;
+			break;
+		case 2:
+			ctx->hc_exec->hx_cpu = (unsigned int)ucl_int;
+			break;
+		case 3:
+			ctx->hc_exec->hx_outmax = (size_t)ucl_int;
+			break;
+		}
+	}
+
+	return (true);
+}
+
+/*
+ * Parse an EXEC node's command, and its optional timeout in seconds
+ * and text its output must contain.
+ */
+static bool
+parse_exec_node(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node,
+    const ucl_object_t *ucl_node)
+{
+	const ucl_object_t *ucl_tmp;
+	hbsdmon_keyvalue_t *kv;
+	uint64_t timeout;
+	int64_t ucl_int;
+	const char *str;
+
+	if (ctx->hc_exec == NULL) {
+		ctx->hc_exec = hbsdmon_exec_new();
+		if (ctx->hc_exec == NULL) {
+			return (false);
+		}
+	}
+
+	ucl_tmp = ucl_lookup_path(ucl_node, ".command");
+	str = (ucl_tmp != NULL) ? ucl_object_tostring(ucl_tmp) : NULL;
+	if (str == NULL || strlen(str) == 0 ||
+	    strlen(str) > HBSDMON_EXEC_CMDMAX) {
+		fprintf(stderr, "[-] Command not defined for host %s\n",
+		    node->hn_host);
+		return (false);
+	}
+	kv = hbsdmon_new_keyvalue();
+	if (kv == NULL ||
+	    !hbsdmon_keyvalue_store(kv, "command", (void *)str,
+	    strlen(str)+1)) {
+		return (false);
+	}
+	hbsdmon_node_append_kv(node, kv);
+
+	ucl_tmp = ucl_lookup_path(ucl_node, ".timeout");
+	if (ucl_tmp != NULL) {
+		if (!ucl_object_toint_safe(ucl_tmp, &ucl_int) ||
+		    ucl_int <= 0 || ucl_int > 3600) {
+			fprintf(stderr, "[-] Timeout of host %s must be"
+			    " 1 to 3600 seconds.\n", node->hn_host);
+			return (false);
+		}
+		timeout = (uint64_t)ucl_int;
+		kv = hbsdmon_new_keyvalue();
+		if (kv == NULL ||
+		    !hbsdmon_keyvalue_store(kv, "exec_timeout", &timeout,
+		    sizeof(timeout))) {
+			return (false);
+		}
+		hbsdmon_node_append_kv(node, kv);
+	}
+
+	ucl_tmp = ucl_lookup_path(ucl_node, ".expect");
+	if (ucl_tmp != NULL) {
+		str = ucl_object_tostring(ucl_tmp);
+		if (str == NULL) {
+			fprintf(stderr, "[-] expect is not a string.\n");
+			return (false);
+		}
+		kv = hbsdmon_new_keyvalue();
+		if (kv == NULL ||
+		    !hbsdmon_keyvalue_store(kv, "expect", (void *)str,
+		    strlen(str)+1)) {
+			return (false);
+		}
+		hbsdmon_node_append_kv(node, kv);
+	}
+
+	node->hn_exec_out = malloc(ctx->hc_exec->hx_outmax + 1);
+	if (node->hn_exec_out == NULL) {
+		return (false);
+	}
+	node->hn_exec_out[0] = '\0';
+
+	return (true);
+}
+
+/*
+ * Parse the optional ZFS section:
+ *
+ * zfs: {
+ *	backend: "libzfs",		# Or "mock"
+ *	events: true,			# Listen for ZFS events
+ *	reconcile: 300,			# Seconds between polls with events
+ *	mock: "/path/to/pools.conf",	# Pool states for "mock"
+ *	mock_events: "/path/to/fifo",	# Fake events for "mock"
+ * }
+ */
+static bool
+parse_zfs(hbsdmon_ctx_t *ctx, const ucl_object_t *top)
+{
+	const ucl_object_t *ucl_zfs, *ucl_tmp;
+	const char *str;
+	int64_t ucl_int;
+
+	ucl_zfs = ucl_lookup_path(top, ".zfs");
+	if (ucl_zfs == NULL) {
+		return (true);
+	}
+
+	str = NULL;
+	ucl_tmp = ucl_lookup_path(ucl_zfs, ".backend");
+	if (ucl_tmp != NULL) {
+		str = ucl_object_tostring(ucl_tmp);
+		if (str == NULL) {
+			fprintf(stderr, "[-] zfs.backend is not a string.\n");
+			return (false);
+		}
+	}
+
+	ctx->hc_zfs = hbsdmon_zfs_new(str);
+	if (ctx->hc_zfs == NULL) {
+		return (false);
+	}
+
+	ucl_tmp = ucl_lookup_path(ucl_zfs, ".mock");
+	if (ucl_tmp != NULL) {
+		str = ucl_object_tostring(ucl_tmp);
+		if (str == NULL) {
+			fprintf(stderr, "[-] zfs.mock is not a string.\n");
+			return (false);
+		}
+		ctx->hc_zfs->hz_mockfile = strdup(str);
+		if (ctx->hc_zfs->hz_mockfile == NULL) {
+			return (false);
+		}
+	}
+
+	ucl_tmp = ucl_lookup_path(ucl_zfs, ".mock_events");
+	if (ucl_tmp != NULL) {
+		str = ucl_object_tostring(ucl_tmp);
+		if (str == NULL) {
+			fprintf(stderr, "[-] zfs.mock_events is not a"
+			    " string.\n");
+			return (false);
+		}
+		ctx->hc_zfs->hz_mockevents = strdup(str);
+		if (ctx->hc_zfs->hz_mockevents == NULL) {
+			return (false);
+		}
 	}
 
+	ucl_tmp = ucl_lookup_path(ucl_zfs, ".events");
+	if (ucl_tmp != NULL) {
+		ctx->hc_zfs->hz_wantevents = ucl_object_toboolean(ucl_tmp);
+	}
+
+	ucl_tmp = ucl_lookup_path(ucl_zfs, ".reconcile");
+	if (ucl_tmp != NULL) {
+		ucl_int = ucl_object_toint(ucl_tmp);
+		if (ucl_int <= 0) {
+			fprintf(stderr, "[-] zfs.reconcile must be a"
+			    " positive number of seconds.\n");
+			return (false);
+		}
+		ctx->hc_zfs->hz_reconcile_ms = (uint64_t)ucl_int * 1000;
+	}
+
+	return (true);
+}
+
+/*
+ * Parse a ZFS node's optional alert thresholds:
+ *
+ * thresholds: {
+ *	capacity: 85,			# Percent
+ *	fragmentation: 60,		# Percent
+ *	errors: 0,			# Errors on any one vdev
+ *	latency: 50,			# Mean I/O latency, in ms
+ * }
+ */
+static bool
+parse_zfs_limits(hbsdmon_node_t *node, const ucl_object_t *ucl_node)
+{
+	static const char *names[] = {
+		"capacity", "fragmentation", "errors", "latency",
+	};
+	const ucl_object_t *ucl_limits, *ucl_tmp;
+	hbsdmon_zfs_limits_t *limits;
+	int64_t vals[nitems(names)];
+	size_t i;
+
+	ucl_limits = ucl_lookup_path(ucl_node, ".thresholds");
+	if (ucl_limits == NULL) {
+		return (true);
+	}
+
+	for (i = 0; i < nitems(names); i++) {
+		vals[i] = -1;
+		ucl_tmp = ucl_object_lookup(ucl_limits, names[i]);
+		if (ucl_tmp == NULL) {
+			continue;
+		}
+		if (!ucl_object_toint_safe(ucl_tmp, &vals[i]) ||
+		    vals[i] < 0) {
+			fprintf(stderr, "[-] Threshold %s of host %s must"
+			    " be a number, 0 or more.\n", names[i],
+			    node->hn_host);
+			return (false);
+		}
+	}
+
+	limits = calloc(1, sizeof(*limits));
+	if (limits == NULL) {
+		return (false);
+	}
+
+	limits->hzl_capacity = vals[0];
+	limits->hzl_frag = vals[1];
+	limits->hzl_errors = vals[2];
+	limits->hzl_latency_ms = vals[3];
+	node->hn_zlimits = limits;
+
 	return (true);
 }
@@ -0,0 +1,374 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hbsdmon.h"
+
+#include <sys/types.h>
+#include <sys/sbuf.h>
+
+#define	DEPS_MARK_NONE		0
+#define	DEPS_MARK_ACTIVE	1
+#define	DEPS_MARK_DONE		2
+
+/* How many dependent nodes a failure notification lists by name. */
+#define	DEPS_DESC_MAX		20
+
+static int hbsdmon_deps_name_cmp(const void *, const void *);
+static hbsdmon_node_t *hbsdmon_deps_find(hbsdmon_node_t **, size_t,
+    const char *);
+static bool hbsdmon_deps_visit(hbsdmon_node_t *);
+static void hbsdmon_deps_collect(hbsdmon_node_t *, int, struct sbuf *,
+    size_t *);
+static bool hbsdmon_deps_describe(hbsdmon_node_t *, int);
+static const char *hbsdmon_deps_node_name(hbsdmon_node_t *);
+
+/*
+ * Turn the depends_on names into parent and child links, and make
+ * sure they form a DAG. Nodes that others depend on get a
+ * description of everything depending on them for their failure
+ * notifications.
+ */
+bool
+hbsdmon_deps_resolve(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_node_t *node, *tnode, *parent, **named;
+	size_t i, nnamed;
+	int stamp;
+
+	nnamed = 0;
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_name != NULL) {
+			nnamed++;
+		}
+	}
+
+	named = calloc(nnamed + 1, sizeof(*named));
+	if (named == NULL) {
+		return (false);
+	}
+
+	nnamed = 0;
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_name != NULL) {
+			named[nnamed++] = node;
+		}
+	}
+
+	qsort(named, nnamed, sizeof(*named), hbsdmon_deps_name_cmp);
+	for (i = 1; i < nnamed; i++) {
+		if (strcmp(named[i - 1]->hn_name, named[i]->hn_name) == 0) {
+			fprintf(stderr, "[-] Node name %s is used more than"
+			    " once.\n", named[i]->hn_name);
+			free(named);
+			return (false);
+		}
+	}
+
+	/* Link every node to its parents, counting children. */
+	ctx->hc_ndeps = 0;
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_ndepnames == 0) {
+			continue;
+		}
+
+		node->hn_parents = calloc(node->hn_ndepnames,
+		    sizeof(*(node->hn_parents)));
+		if (node->hn_parents == NULL) {
+			free(named);
+			return (false);
+		}
+
+		for (i = 0; i < node->hn_ndepnames; i++) {
+			parent = hbsdmon_deps_find(named, nnamed,
+			    node->hn_depnames[i]);
+			if (parent == NULL || parent == node) {
+				fprintf(stderr, "[-] %s depends on unknown"
+				    " node %s.\n",
+				    hbsdmon_deps_node_name(node),
+				    node->hn_depnames[i]);
+				free(named);
+				return (false);
+			}
+			node->hn_parents[node->hn_nparents++] = parent;
+			parent->hn_nchildren++;
+			ctx->hc_ndeps++;
+		}
+	}
+
+	free(named);
+
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_nchildren == 0) {
+			continue;
+		}
+		node->hn_children = calloc(node->hn_nchildren,
+		    sizeof(*(node->hn_children)));
+		if (node->hn_children == NULL) {
+			return (false);
+		}
+		node->hn_nchildren = 0;
+	}
+
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		for (i = 0; i < node->hn_nparents; i++) {
+			parent = node->hn_parents[i];
+			parent->hn_children[parent->hn_nchildren++] = node;
+		}
+	}
+
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		node->hn_mark = DEPS_MARK_NONE;
+	}
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_mark == DEPS_MARK_NONE &&
+		    !hbsdmon_deps_visit(node)) {
+			return (false);
+		}
+	}
+
+	/* Each description walk marks the nodes it saw with its own stamp. */
+	stamp = DEPS_MARK_DONE;
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_nchildren > 0 &&
+		    !hbsdmon_deps_describe(node, ++stamp)) {
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+/*
+ * The main thread learned that a node went down or came back up.
+ * A node is unreachable when every one of its parents is down or
+ * unreachable itself. Unreachable nodes aren't probed. Once they're
+ * reachable again, they're re-checked right away, spaced out by
+ * HBSDMON_RECHECK_SPACING_MS.
+ */
+void
+hbsdmon_deps_update(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node)
+{
+	hbsdmon_node_t **stack, *child, *parent;
+	uint64_t delay, now;
+	size_t i, nstack;
+	bool unreachable;
+
+	if (node->hn_nchildren == 0) {
+		return;
+	}
+
+	/*
+	 * Reachability only changes in one direction per update, so
+	 * each link is followed at most once.
+	 */
+	stack = calloc(ctx->hc_ndeps, sizeof(*stack));
+	if (stack == NULL) {
+		return;
+	}
+
+	nstack = 0;
+	for (i = 0; i < node->hn_nchildren; i++) {
+		stack[nstack++] = node->hn_children[i];
+	}
+
+	while (nstack > 0) {
+		child = stack[--nstack];
+
+		unreachable = true;
+		for (i = 0; i < child->hn_nparents; i++) {
+			parent = child->hn_parents[i];
+			if (parent->hn_shared_lastfail == 0 &&
+			    parent->hn_unreachable == false) {
+				unreachable = false;
+				break;
+			}
+		}
+
+		if (unreachable == child->hn_unreachable) {
+			continue;
+		}
+
+		child->hn_unreachable = unreachable;
+		delay = 0;
+		if (unreachable) {
+			ctx->hc_nunreachable++;
+		} else {
+			ctx->hc_nunreachable--;
+			now = hbsdmon_now_ms();
+			if (ctx->hc_recheck_next < now) {
+				ctx->hc_recheck_next = now;
+			}
+			delay = ctx->hc_recheck_next - now;
+			ctx->hc_recheck_next += HBSDMON_RECHECK_SPACING_MS;
+		}
+
+		hbsdmon_node_tell(child, VERB_PAUSE, unreachable, delay);
+
+		for (i = 0; i < child->hn_nchildren; i++) {
+			stack[nstack++] = child->hn_children[i];
+		}
+	}
+
+	free(stack);
+}
+
+static int
+hbsdmon_deps_name_cmp(const void *a, const void *b)
+{
+	hbsdmon_node_t * const *na, * const *nb;
+
+	na = a;
+	nb = b;
+
+	return (strcmp((*na)->hn_name, (*nb)->hn_name));
+}
+
+static hbsdmon_node_t *
+hbsdmon_deps_find(hbsdmon_node_t **named, size_t nnamed, const char *name)
+{
+	size_t lo, hi, mid;
+	int cmp;
+
+	lo = 0;
+	hi = nnamed;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(name, named[mid]->hn_name);
+		if (cmp == 0) {
+			return (named[mid]);
+		}
+		if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Depth-first search for cycles. Reaching a node that is still on
+ * the current path means it depends on itself.
+ */
+static bool
+hbsdmon_deps_visit(hbsdmon_node_t *node)
+{
+	hbsdmon_node_t *child;
+	size_t i;
+
+	node->hn_mark = DEPS_MARK_ACTIVE;
+
+	for (i = 0; i < node->hn_nchildren; i++) {
+		child = node->hn_children[i];
+		switch (child->hn_mark) {
+		case DEPS_MARK_ACTIVE:
+			fprintf(stderr, "[-] Dependency cycle: %s depends on"
+			    " %s, which depends on it.\n",
+			    hbsdmon_deps_node_name(child),
+			    hbsdmon_deps_node_name(node));
+			return (false);
+		case DEPS_MARK_NONE:
+			if (!hbsdmon_deps_visit(child)) {
+				return (false);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	node->hn_mark = DEPS_MARK_DONE;
+	return (true);
+}
+
+static void
+hbsdmon_deps_collect(hbsdmon_node_t *node, int stamp, struct sbuf *sb,
+    size_t *ndesc)
+{
+	hbsdmon_node_t *child;
+	size_t i;
+
+	for (i = 0; i < node->hn_nchildren; i++) {
+		child = node->hn_children[i];
+		if (child->hn_mark == stamp) {
+			continue;
+		}
+		child->hn_mark = stamp;
+		if (*ndesc < DEPS_DESC_MAX) {
+			sbuf_printf(sb, "%s\n", hbsdmon_deps_node_name(child));
+		}
+		(*ndesc)++;
+		hbsdmon_deps_collect(child, stamp, sb, ndesc);
+	}
+}
+
+/*
+ * Render the list of nodes depending on this one, directly or not.
+ * Their own failures aren't alerted on while this node is down, so
+ * this node's failure notification names them instead.
+ */
+static bool
+hbsdmon_deps_describe(hbsdmon_node_t *node, int stamp)
+{
+	struct sbuf *sb;
+	size_t ndesc;
+
+	sb = sbuf_new_auto();
+	if (sb == NULL) {
+		return (false);
+	}
+
+	sbuf_cat(sb, "\nDependent nodes (not alerted on separately):\n");
+	ndesc = 0;
+	node->hn_mark = stamp;
+	hbsdmon_deps_collect(node, stamp, sb, &ndesc);
+	if (ndesc > DEPS_DESC_MAX) {
+		sbuf_printf(sb, "... and %zu more\n", ndesc - DEPS_DESC_MAX);
+	}
+
+	if (sbuf_finish(sb)) {
+		sbuf_delete(sb);
+		return (false);
+	}
+
+	node->hn_deps_desc = strdup(sbuf_data(sb));
+	sbuf_delete(sb);
+
+	return (node->hn_deps_desc != NULL);
+}
+
+static const char *
+hbsdmon_deps_node_name(hbsdmon_node_t *node)
+{
+
+	return (node->hn_name != NULL ? node->hn_name : node->hn_host);
+}
@@ -0,0 +1,744 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * The EXEC method runs a command and maps how it ends to the node's
+ * state. Commands are run by a pool of helper processes, forked
+ * before any thread is started, so the probe threads never fork
+ * themselves. A helper reads one request at a time from its socket,
+ * forks the command in a process group of its own, collects its
+ * output, reaps it and answers. Only when a helper is gone does a
+ * probe thread spawn the command with posix_spawn(3) instead.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/sbuf.h>
+#include <sys/wait.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hbsdmon.h"
+
+extern char **environ;
+
+typedef struct _hbsdmon_exec_req {
+	uint32_t			 hxr_timeout_ms;
+	uint32_t			 hxr_cpu;
+	uint32_t			 hxr_outmax;
+	uint32_t			 hxr_hostlen;
+	uint32_t			 hxr_cmdlen;
+} hbsdmon_exec_req_t;
+
+static bool hbsdmon_exec_readn(int, void *, size_t);
+static bool hbsdmon_exec_writen(int, const void *, size_t);
+static void hbsdmon_exec_worker(int);
+static void hbsdmon_exec_collect(pid_t, int, uint64_t, char *, size_t,
+    const _Atomic bool *, hbsdmon_exec_result_t *);
+static int hbsdmon_exec_dispatch(hbsdmon_exec_t *,
+    hbsdmon_exec_worker_t *, hbsdmon_node_t *, const char *,
+    uint64_t);
+static void hbsdmon_exec_spawn(hbsdmon_exec_t *, hbsdmon_node_t *,
+    const char *, uint64_t);
+static void hbsdmon_exec_reap(hbsdmon_exec_worker_t *);
+
+hbsdmon_exec_t *
+hbsdmon_exec_new(void)
+{
+	hbsdmon_exec_t *exec;
+
+	exec = calloc(1, sizeof(*exec));
+	if (exec == NULL) {
+		return (NULL);
+	}
+
+	exec->hx_nworkers = HBSDMON_EXEC_WORKERS;
+	exec->hx_timeout = HBSDMON_EXEC_TIMEOUT;
+	exec->hx_outmax = HBSDMON_EXEC_OUTMAX;
+	pthread_mutex_init(&(exec->hx_mtx), NULL);
+	pthread_cond_init(&(exec->hx_cv), NULL);
+
+	return (exec);
+}
+
+/*
+ * Fork the helpers. This must happen before any thread is started. A
+ * helper that can't be forked leaves its slot to posix_spawn(3).
+ */
+bool
+hbsdmon_exec_init(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_exec_worker_t *worker;
+	hbsdmon_exec_t *exec;
+	int fds[2];
+	size_t i;
+
+	exec = ctx->hc_exec;
+	if (exec == NULL) {
+		return (true);
+	}
+
+	exec->hx_workers = calloc(exec->hx_nworkers,
+	    sizeof(*(exec->hx_workers)));
+	if (exec->hx_workers == NULL) {
+		return (false);
+	}
+
+	for (i = 0; i < exec->hx_nworkers; i++) {
+		worker = &(exec->hx_workers[i]);
+		worker->hew_pid = -1;
+		worker->hew_fd = -1;
+
+		if (socketpair(PF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0,
+		    fds) == -1) {
+			perror("[-] socketpair");
+			continue;
+		}
+
+		/* Flush, so the helpers don't write our output again. */
+		fflush(NULL);
+		worker->hew_pid = fork();
+		switch (worker->hew_pid) {
+		case -1:
+			perror("[-] fork");
+			close(fds[0]);
+			close(fds[1]);
+			continue;
+		case 0:
+			close(fds[0]);
+			hbsdmon_exec_worker(fds[1]);
+			/* NOTREACHED */
+		default:
+			close(fds[1]);
+			worker->hew_fd = fds[0];
+			break;
+		}
+	}
+
+	return (true);
+}
+
+/*
+ * Close the helpers' sockets, which makes them exit once they're
+ * done with their command, and reap them. Helpers that take longer
+ * than HBSDMON_TERM_TIMEOUT_MS are killed.
+ */
+void
+hbsdmon_exec_fini(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_exec_worker_t *worker;
+	hbsdmon_exec_t *exec;
+	uint64_t deadline;
+	size_t i, nalive;
+
+	exec = ctx->hc_exec;
+	if (exec == NULL || exec->hx_workers == NULL) {
+		return;
+	}
+
+	for (i = 0; i < exec->hx_nworkers; i++) {
+		if (exec->hx_workers[i].hew_fd != -1) {
+			close(exec->hx_workers[i].hew_fd);
+			exec->hx_workers[i].hew_fd = -1;
+		}
+	}
+
+	deadline = hbsdmon_now_ms() + HBSDMON_TERM_TIMEOUT_MS;
+	do {
+		nalive = 0;
+		for (i = 0; i < exec->hx_nworkers; i++) {
+			worker = &(exec->hx_workers[i]);
+			if (worker->hew_pid == -1) {
+				continue;
+			}
+			if (waitpid(worker->hew_pid, NULL, WNOHANG) == 0) {
+				nalive++;
+				continue;
+			}
+			worker->hew_pid = -1;
+		}
+		if (nalive > 0) {
+			usleep(HBSDMON_ABORT_POLL_MS * 1000);
+		}
+	} while (nalive > 0 && hbsdmon_now_ms() < deadline);
+
+	for (i = 0; i < exec->hx_nworkers; i++) {
+		hbsdmon_exec_reap(&(exec->hx_workers[i]));
+	}
+}
+
+/*
+ * Run the node's command and report whether it exited with status 0
+ * and, if the node expects something in the output, printed it.
+ */
+bool
+hbsdmon_exec_ping(hbsdmon_node_t *node)
+{
+	hbsdmon_exec_worker_t *worker;
+	hbsdmon_keyvalue_t *kv;
+	hbsdmon_exec_t *exec;
+	hbsdmon_ctx_t *ctx;
+	uint64_t start, timeout_ms;
+	struct timespec ts;
+	const char *cmd;
+	bool spawned;
+	int answer;
+	size_t i;
+
+	ctx = node->hn_thread->ht_ctx;
+	exec = ctx->hc_exec;
+	assert(exec != NULL);
+
+	kv = hbsdmon_find_kv_in_node(node, "command", false);
+	assert(kv != NULL);
+	cmd = hbsdmon_keyvalue_to_str(kv);
+
+	timeout_ms = (uint64_t)exec->hx_timeout * 1000;
+	kv = hbsdmon_find_kv_in_node(node, "exec_timeout", false);
+	if (kv != NULL) {
+		timeout_ms = hbsdmon_keyvalue_to_uint64(kv) * 1000;
+	}
+
+	/* Wait for a free slot. */
+	pthread_mutex_lock(&(exec->hx_mtx));
+	while (true) {
+		worker = NULL;
+		for (i = 0; i < exec->hx_nworkers; i++) {
+			if (!exec->hx_workers[i].hew_busy) {
+				worker = &(exec->hx_workers[i]);
+				break;
+			}
+		}
+		if (worker != NULL) {
+			break;
+		}
+		if (ctx->hc_stopping) {
+			pthread_mutex_unlock(&(exec->hx_mtx));
+			return (false);
+		}
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += HBSDMON_ABORT_POLL_MS * 1000000L;
+		ts.tv_sec += ts.tv_nsec / 1000000000L;
+		ts.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&(exec->hx_cv), &(exec->hx_mtx), &ts);
+	}
+	worker->hew_busy = true;
+	pthread_mutex_unlock(&(exec->hx_mtx));
+
+	start = hbsdmon_now_us();
+	spawned = false;
+	answer = (worker->hew_pid == -1) ? 0 :
+	    hbsdmon_exec_dispatch(exec, worker, node, cmd, timeout_ms);
+	if (answer != 1) {
+		hbsdmon_exec_reap(worker);
+	}
+	if (answer == -1) {
+		memset(&(node->hn_exec_res), 0, sizeof(node->hn_exec_res));
+		node->hn_exec_res.her_state = EXEC_TIMEDOUT;
+	} else if (answer == 0 && !ctx->hc_stopping) {
+		hbsdmon_exec_spawn(exec, node, cmd, timeout_ms);
+		spawned = true;
+	}
+
+	pthread_mutex_lock(&(exec->hx_mtx));
+	worker->hew_busy = false;
+	pthread_cond_signal(&(exec->hx_cv));
+	pthread_mutex_unlock(&(exec->hx_mtx));
+
+	if (ctx->hc_stopping) {
+		return (false);
+	}
+
+	hbsdmon_probe_time(&(node->hn_probe), PHASE_TOTAL,
+	    hbsdmon_now_us() - start);
+
+	hbsdmon_lock_ctx(ctx);
+	ctx->hc_stats.hs_nexecs++;
+	if (spawned) {
+		ctx->hc_stats.hs_nexec_spawns++;
+	}
+	if (node->hn_exec_res.her_state == EXEC_TIMEDOUT) {
+		ctx->hc_stats.hs_nexec_timeouts++;
+	}
+	hbsdmon_unlock_ctx(ctx);
+
+	node->hn_exec_out[node->hn_exec_res.her_outlen] = '\0';
+	if (node->hn_exec_res.her_state != EXEC_EXITED ||
+	    node->hn_exec_res.her_code != 0) {
+		node->hn_probe.hp_failed = PHASE_TOTAL;
+		return (false);
+	}
+
+	kv = hbsdmon_find_kv_in_node(node, "expect", false);
+	if (kv != NULL && strstr(node->hn_exec_out,
+	    hbsdmon_keyvalue_to_str(kv)) == NULL) {
+		node->hn_probe.hp_failed = PHASE_TOTAL;
+		return (false);
+	}
+
+	return (true);
+}
+
+/* Describe how the node's last command ended, for notifications. */
+void
+hbsdmon_exec_to_sbuf(hbsdmon_node_t *node, struct sbuf *sb)
+{
+	hbsdmon_exec_result_t *res;
+	hbsdmon_keyvalue_t *kv;
+	size_t len;
+
+	res = &(node->hn_exec_res);
+	switch (res->her_state) {
+	case EXEC_EXITED:
+		sbuf_printf(sb, "\nExit status: %d\n", res->her_code);
+		break;
+	case EXEC_SIGNALED:
+		sbuf_printf(sb, "\nKilled by signal %d\n", res->her_code);
+		break;
+	case EXEC_TIMEDOUT:
+		sbuf_cat(sb, "\nTimed out\n");
+		break;
+	case EXEC_FAILED:
+		sbuf_cat(sb, "\nCould not be run\n");
+		return;
+	}
+
+	kv = hbsdmon_find_kv_in_node(node, "expect", false);
+	if (kv != NULL && res->her_state == EXEC_EXITED &&
+	    res->her_code == 0) {
+		sbuf_printf(sb, "Output lacks: %s\n",
+		    hbsdmon_keyvalue_to_str(kv));
+	}
+
+	len = res->her_outlen;
+	while (len > 0 && (node->hn_exec_out[len - 1] == '\n' ||
+	    node->hn_exec_out[len - 1] == '\r')) {
+		len--;
+	}
+	if (len > 0) {
+		sbuf_printf(sb, "Output:\n%.*s\n", (int)len,
+		    node->hn_exec_out);
+	}
+}
+
+static bool
+hbsdmon_exec_readn(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, buf, len);
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return (false);
+		}
+		buf = (char *)buf + n;
+		len -= n;
+	}
+
+	return (true);
+}
+
+static bool
+hbsdmon_exec_writen(int fd, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		/* A helper that's gone must not SIGPIPE us. */
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return (false);
+		}
+		buf = (const char *)buf + n;
+		len -= n;
+	}
+
+	return (true);
+}
+
+/*
+ * The helper's loop. It exits when hbsdmon closes its end of the
+ * socket.
+ */
+static void
+hbsdmon_exec_worker(int fd)
+{
+	hbsdmon_exec_result_t res;
+	hbsdmon_exec_req_t req;
+	struct rlimit rl;
+	char *buf, *cmd;
+	int null, out[2];
+	pid_t pid;
+
+	/* Leave ^C and friends to hbsdmon, which closes our socket. */
+	signal(SIGINT, SIG_IGN);
+	signal(SIGTERM, SIG_IGN);
+	signal(SIGINFO, SIG_IGN);
+
+	while (hbsdmon_exec_readn(fd, &req, sizeof(req))) {
+		if (req.hxr_hostlen > HBSDMON_EXEC_CMDMAX ||
+		    req.hxr_cmdlen > HBSDMON_EXEC_CMDMAX ||
+		    req.hxr_outmax > 65536) {
+			break;
+		}
+
+		/* Host, command and output, in one allocation. */
+		buf = malloc(req.hxr_hostlen + req.hxr_cmdlen + 2 +
+		    req.hxr_outmax);
+		if (buf == NULL) {
+			break;
+		}
+		cmd = buf + req.hxr_hostlen + 1;
+		if (!hbsdmon_exec_readn(fd, buf, req.hxr_hostlen) ||
+		    !hbsdmon_exec_readn(fd, cmd, req.hxr_cmdlen)) {
+			break;
+		}
+		buf[req.hxr_hostlen] = '\0';
+		cmd[req.hxr_cmdlen] = '\0';
+
+		memset(&res, 0, sizeof(res));
+		res.her_state = EXEC_FAILED;
+		if (pipe2(out, O_CLOEXEC) == -1) {
+			goto answer;
+		}
+
+		pid = fork();
+		switch (pid) {
+		case -1:
+			close(out[0]);
+			close(out[1]);
+			break;
+		case 0:
+			setpgid(0, 0);
+			null = open("/dev/null", O_RDONLY);
+			if (null != -1) {
+				dup2(null, STDIN_FILENO);
+			}
+			dup2(out[1], STDOUT_FILENO);
+			dup2(out[1], STDERR_FILENO);
+			if (req.hxr_cpu > 0) {
+				rl.rlim_cur = req.hxr_cpu;
+				rl.rlim_max = req.hxr_cpu + 1;
+				setrlimit(RLIMIT_CPU, &rl);
+			}
+			setenv("HBSDMON_HOST", buf, 1);
+			execl(HBSDMON_EXEC_SHELL, "sh", "-c", cmd,
+			    (char *)NULL);
+			_exit(127);
+		default:
+			/* Both sides, so killpg() can't miss it. */
+			setpgid(pid, pid);
+			close(out[1]);
+			hbsdmon_exec_collect(pid, out[0],
+			    req.hxr_timeout_ms, cmd + req.hxr_cmdlen + 1,
+			    req.hxr_outmax, NULL, &res);
+			break;
+		}
+
+answer:
+		if (!hbsdmon_exec_writen(fd, &res, sizeof(res)) ||
+		    !hbsdmon_exec_writen(fd, cmd + req.hxr_cmdlen + 1,
+		    res.her_outlen)) {
+			break;
+		}
+		free(buf);
+	}
+
+	_exit(0);
+}
+
+/*
+ * Read the output of the command running as pid from fd until it
+ * exits, keeping the first outmax bytes, and reap it. If it's still
+ * running after timeout_ms, or when *stop is set, its whole process
+ * group is killed.
+ */
+static void
+hbsdmon_exec_collect(pid_t pid, int fd, uint64_t timeout_ms, char *out,
+    size_t outmax, const _Atomic bool *stop, hbsdmon_exec_result_t *res)
+{
+	uint64_t deadline, now, wait;
+	char discard[512];
+	struct pollfd pfd;
+	bool eof, exited;
+	siginfo_t si;
+	int status;
+	ssize_t n;
+
+	memset(res, 0, sizeof(*res));
+	deadline = hbsdmon_now_ms() + timeout_ms;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	eof = exited = false;
+
+	/*
+	 * The command may exit while something it started keeps the
+	 * pipe open, or close the pipe and keep running. Either way
+	 * it's done when it has exited and the pipe is drained, or
+	 * when time is up.
+	 */
+	while (!exited || !eof) {
+		now = hbsdmon_now_ms();
+		if (now >= deadline || (stop != NULL && *stop)) {
+			break;
+		}
+		wait = deadline - now;
+		if (wait > HBSDMON_ABORT_POLL_MS) {
+			wait = HBSDMON_ABORT_POLL_MS;
+		}
+
+		/* Left a zombie, so its pid can't be reused yet. */
+		memset(&si, 0, sizeof(si));
+		if (!exited && waitid(P_PID, pid, &si,
+		    WEXITED | WNOHANG | WNOWAIT) == 0 && si.si_pid == pid) {
+			exited = true;
+			/* Only wait briefly for stragglers. */
+			if (!eof && deadline > now + HBSDMON_ABORT_POLL_MS) {
+				deadline = now + HBSDMON_ABORT_POLL_MS;
+			}
+			continue;
+		}
+
+		if (eof) {
+			usleep(wait < 10 ? wait * 1000 : 10000);
+			continue;
+		}
+
+		if (poll(&pfd, 1, (int)wait) <= 0) {
+			continue;
+		}
+
+		if (res->her_outlen < outmax) {
+			n = read(fd, out + res->her_outlen,
+			    outmax - res->her_outlen);
+		} else {
+			n = read(fd, discard, sizeof(discard));
+		}
+		if (n == -1 && (errno == EINTR || errno == EAGAIN)) {
+			continue;
+		}
+		if (n <= 0) {
+			eof = true;
+			continue;
+		}
+		if (res->her_outlen < outmax) {
+			res->her_outlen += n;
+		}
+	}
+
+	close(fd);
+
+	/* Whatever is left of the group goes, then the command is reaped. */
+	killpg(pid, SIGKILL);
+	while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+		continue;
+	}
+
+	if (!exited) {
+		res->her_state = EXEC_TIMEDOUT;
+	} else if (WIFSIGNALED(status)) {
+		res->her_state = EXEC_SIGNALED;
+		res->her_code = WTERMSIG(status);
+	} else {
+		res->her_state = EXEC_EXITED;
+		res->her_code = WEXITSTATUS(status);
+	}
+}
+
+/*
+ * Have the worker's helper run the command. Returns 1 when it
+ * answered, 0 when it's gone and -1 when it didn't answer in time.
+ * Either way, it's no use anymore unless it answered.
+ */
+static int
+hbsdmon_exec_dispatch(hbsdmon_exec_t *exec, hbsdmon_exec_worker_t *worker,
+    hbsdmon_node_t *node, const char *cmd, uint64_t timeout_ms)
+{
+	hbsdmon_exec_req_t req;
+	uint64_t deadline, now;
+	struct pollfd pfd;
+
+	memset(&req, 0, sizeof(req));
+	req.hxr_timeout_ms = (uint32_t)timeout_ms;
+	req.hxr_cpu = exec->hx_cpu;
+	req.hxr_outmax = (uint32_t)exec->hx_outmax;
+	req.hxr_hostlen = (uint32_t)strlen(node->hn_host);
+	req.hxr_cmdlen = (uint32_t)strlen(cmd);
+
+	if (!hbsdmon_exec_writen(worker->hew_fd, &req, sizeof(req)) ||
+	    !hbsdmon_exec_writen(worker->hew_fd, node->hn_host,
+	    req.hxr_hostlen) ||
+	    !hbsdmon_exec_writen(worker->hew_fd, cmd, req.hxr_cmdlen)) {
+		return (0);
+	}
+
+	pfd.fd = worker->hew_fd;
+	pfd.events = POLLIN;
+	deadline = hbsdmon_now_ms() + timeout_ms + HBSDMON_EXEC_GRACE_MS;
+	while (true) {
+		now = hbsdmon_now_ms();
+		if (now >= deadline || node->hn_thread->ht_ctx->hc_stopping) {
+			return (-1);
+		}
+		if (poll(&pfd, 1, HBSDMON_ABORT_POLL_MS) > 0) {
+			break;
+		}
+	}
+
+	if (!hbsdmon_exec_readn(worker->hew_fd, &(node->hn_exec_res),
+	    sizeof(node->hn_exec_res)) ||
+	    node->hn_exec_res.her_outlen > exec->hx_outmax ||
+	    !hbsdmon_exec_readn(worker->hew_fd, node->hn_exec_out,
+	    node->hn_exec_res.her_outlen)) {
+		return (0);
+	}
+
+	return (1);
+}
+
+/*
+ * Run the command from this thread. posix_spawn(3) is safe to use
+ * with threads around, where fork(2) isn't.
+ */
+static void
+hbsdmon_exec_spawn(hbsdmon_exec_t *exec, hbsdmon_node_t *node,
+    const char *cmd, uint64_t timeout_ms)
+{
+	posix_spawn_file_actions_t actions;
+	char *argv[4], **envp, *host, *script;
+	posix_spawnattr_t attr;
+	size_t i, nenv;
+	sigset_t mask;
+	int out[2];
+	pid_t pid;
+
+	memset(&(node->hn_exec_res), 0, sizeof(node->hn_exec_res));
+	node->hn_exec_res.her_state = EXEC_FAILED;
+
+	script = NULL;
+	if (exec->hx_cpu > 0) {
+		if (asprintf(&script, "ulimit -t %u; %s", exec->hx_cpu,
+		    cmd) == -1) {
+			return;
+		}
+	}
+	host = NULL;
+	if (asprintf(&host, "HBSDMON_HOST=%s", node->hn_host) == -1) {
+		free(script);
+		return;
+	}
+
+	for (nenv = 0; environ[nenv] != NULL; nenv++) {
+		continue;
+	}
+	envp = calloc(nenv + 2, sizeof(*envp));
+	if (envp == NULL) {
+		free(host);
+		free(script);
+		return;
+	}
+	for (i = 0; i < nenv; i++) {
+		envp[i] = environ[i];
+	}
+	envp[nenv] = host;
+
+	argv[0] = "sh";
+	argv[1] = "-c";
+	argv[2] = (script != NULL) ? script : (char *)cmd;
+	argv[3] = NULL;
+
+	if (pipe2(out, O_CLOEXEC) == -1) {
+		goto end;
+	}
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO,
+	    "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDERR_FILENO);
+
+	sigemptyset(&mask);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+	    POSIX_SPAWN_SETSIGMASK);
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setsigmask(&attr, &mask);
+
+	if (posix_spawn(&pid, HBSDMON_EXEC_SHELL, &actions, &attr, argv,
+	    envp) == 0) {
+		close(out[1]);
+		hbsdmon_exec_collect(pid, out[0], timeout_ms,
+		    node->hn_exec_out, exec->hx_outmax,
+		    &(node->hn_thread->ht_ctx->hc_stopping),
+		    &(node->hn_exec_res));
+	} else {
+		close(out[0]);
+		close(out[1]);
+	}
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+end:
+	free(envp);
+	free(host);
+	free(script);
+}
+
+/* Kill and reap the worker's helper, if it's still around. */
+static void
+hbsdmon_exec_reap(hbsdmon_exec_worker_t *worker)
+{
+
+	if (worker->hew_fd != -1) {
+		close(worker->hew_fd);
+		worker->hew_fd = -1;
+	}
+	if (worker->hew_pid != -1) {
+		kill(worker->hew_pid, SIGKILL);
+		while (waitpid(worker->hew_pid, NULL, 0) == -1 &&
+		    errno == EINTR) {
+			continue;
+		}
+		worker->hew_pid = -1;
+	}
+}
@@ -25,13 +25,12 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#include <pthread_np.h>
-
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/sbuf.h>
@@ -55,7 +54,6 @@ static void dispatch_signal(hbsdmon_ctx_t *);
 static void dispatch_term(hbsdmon_ctx_t *);
 static void dispatch_info(hbsdmon_ctx_t *);
 static void hbsdmon_heartbeat(hbsdmon_ctx_t *);
-static char *hbsdmon_stats_to_str(hbsdmon_ctx_t *);
 static bool hbsdmon_init_heartbeat(hbsdmon_ctx_t *);
 
 int
@@ -69,11 +67,18 @@ main(int argc, char *argv[])
 	if (ctx == NULL)
 		return (1);
 
-	while ((ch = getopt(argc, argv, "c:")) != -1) {
+#ifdef NOSUBMIT
+	ctx->hc_dryrun = true;
+#endif
+
+	while ((ch = getopt(argc, argv, "c:n")) != -1) {
 		switch (ch) {
 		case 'c':
 			ctx->hc_config = strdup(optarg);
 			break;
+		case 'n':
+			ctx->hc_dryrun = true;
+			break;
 		}
 	}
 
@@ -82,6 +87,13 @@ main(int argc, char *argv[])
 		return (1);
 	}
 
+	/* The EXEC helpers must be forked before any thread starts. */
+	if (hbsdmon_exec_init(ctx) == false) {
+		fprintf(stderr, "[-] Unable to start the EXEC helpers."
+		    " Bailing.\n");
+		return (1);
+	}
+
 	pthread_mutex_init(&(ctx->hc_mtx), NULL);
 
 	if (curl_global_init(CURL_GLOBAL_ALL)) {
@@ -90,6 +102,18 @@ main(int argc, char *argv[])
 	}
 
 	hbsdmon_init_heartbeat(ctx);
+	hbsdmon_notify_init(ctx);
+	hbsdmon_notify_replay(ctx);
+
+	if (hbsdmon_cluster_init(ctx) == false) {
+		fprintf(stderr, "[-] Unable to join the cluster. Bailing.\n");
+		return (1);
+	}
+
+	if (hbsdmon_zfs_init(ctx) == false) {
+		fprintf(stderr, "[-] Unable to initialize ZFS. Bailing.\n");
+		return (1);
+	}
 
 	res = 0;
 
@@ -109,6 +133,11 @@ main(int argc, char *argv[])
 	assert(ctx->hc_nthreads == ctx->hc_nnodes);
 
 	main_loop(ctx);
+	hbsdmon_plugin_fini(ctx);
+	hbsdmon_exec_fini(ctx);
+	hbsdmon_zfs_fini(ctx);
+	hbsdmon_cluster_fini(ctx);
+	hbsdmon_notify_fini(ctx);
 	pushover_free_ctx(&(ctx->hc_psh_ctx));
 
 	return (res);
@@ -120,23 +149,36 @@ main_loop(hbsdmon_ctx_t *ctx)
 	hbsdmon_thread_t *thread, *tmpthread;
 	zmq_pollitem_t *pollitems;
 	hbsdmon_thread_msg_t msg;
+	uint64_t due, now, lag;
 	hbsdmon_node_t *node;
+	int i, nitems, nthreads, plugidx, zfsidx;
+	hbsdmon_plugin_mod_t *mod;
+	void *clustersock, *zfssock;
 	bool breakout;
-	int i, nitems;
 
-	pollitems = calloc(ctx->hc_nnodes, sizeof(*pollitems));
+	/*
+	 * One slot per thread, plus the cluster and ZFS event sockets
+	 * and the plugins' descriptors.
+	 */
+	pollitems = calloc(ctx->hc_nnodes + 2 + ctx->hc_nplugins,
+	    sizeof(*pollitems));
 	if (pollitems == NULL) {
 		return;
 	}
 
+	clustersock = hbsdmon_cluster_socket(ctx);
+	zfssock = hbsdmon_zfs_socket(ctx);
+
 	breakout = false;
 	while (true) {
 		hbsdmon_heartbeat(ctx);
+		hbsdmon_cluster_tick(ctx);
 		/*
 		 * XXX I really dislike that ZeroMQ went with signed 
 		 * integers.
 		 */
-		memset(pollitems, 0, ctx->hc_nthreads * sizeof(*pollitems));
+		memset(pollitems, 0, (ctx->hc_nthreads + 2 +
+		    ctx->hc_nplugins) * sizeof(*pollitems));
 
 		nitems = 0;
 		SLIST_FOREACH_SAFE(thread, &(ctx->hc_threads), ht_entry,
@@ -145,8 +187,49 @@ main_loop(hbsdmon_ctx_t *ctx)
 			pollitems[nitems].events = ZMQ_POLLIN;
 			nitems++;
 		}
+		nthreads = nitems;
+
+		if (clustersock != NULL) {
+			pollitems[nitems].socket = clustersock;
+			pollitems[nitems].events = ZMQ_POLLIN;
+			nitems++;
+		}
+
+		zfsidx = nitems;
+		if (zfssock != NULL) {
+			pollitems[nitems].socket = zfssock;
+			pollitems[nitems].events = ZMQ_POLLIN;
+			nitems++;
+		}
+
+		plugidx = nitems;
+		SLIST_FOREACH(mod, &(ctx->hc_plugins), hpm_entry) {
+			if (mod->hpm_fd == -1) {
+				continue;
+			}
+			pollitems[nitems].fd = mod->hpm_fd;
+			pollitems[nitems].events = ZMQ_POLLIN;
+			nitems++;
+		}
 
-		nitems = zmq_poll(pollitems, nitems, ctx->hc_heartbeat * 1000);
+		due = hbsdmon_now_ms() + HBSDMON_MAIN_TICK_MS;
+		nitems = zmq_poll(pollitems, nitems, HBSDMON_MAIN_TICK_MS);
+
+		/*
+		 * A timed out poll tells us how late the main loop wakes
+		 * up, which it does when the host or the process is
+		 * overloaded.
+		 */
+		if (nitems == 0) {
+			now = hbsdmon_now_ms();
+			lag = (now > due) ? now - due : 0;
+			hbsdmon_lock_ctx(ctx);
+			hbsdmon_hist_add(&(ctx->hc_stats.hs_wakelag), lag);
+			if (lag >= HBSDMON_LATE_MS) {
+				ctx->hc_stats.hs_nlatewakes++;
+			}
+			hbsdmon_unlock_ctx(ctx);
+		}
 
 		if (appflags) {
 			if ((appflags & APPFLAG_TERM)  ==
@@ -163,7 +246,27 @@ main_loop(hbsdmon_ctx_t *ctx)
 			}
 		}
 
-		for (i = 0; i < ctx->hc_nthreads; i++) {
+		if (clustersock != NULL &&
+		    (pollitems[nthreads].revents & ZMQ_POLLIN)) {
+			hbsdmon_cluster_recv(ctx);
+		}
+
+		if (zfssock != NULL &&
+		    (pollitems[zfsidx].revents & ZMQ_POLLIN)) {
+			hbsdmon_zfs_recv(ctx);
+		}
+
+		i = plugidx;
+		SLIST_FOREACH(mod, &(ctx->hc_plugins), hpm_entry) {
+			if (mod->hpm_fd == -1) {
+				continue;
+			}
+			if (pollitems[i++].revents & ZMQ_POLLIN) {
+				hbsdmon_plugin_recv(ctx, mod);
+			}
+		}
+
+		for (i = 0; i < nthreads; i++) {
 			if (pollitems[i].revents & ZMQ_POLLIN) {
 				node = hbsdmon_find_node_by_zmqsock(
 				    ctx, pollitems[i].socket);
@@ -177,7 +280,7 @@ main_loop(hbsdmon_ctx_t *ctx)
 					    " Unable to handle message"
 					    " from node %s (method %s)",
 					    node->hn_host,
-					    hbsdmon_method_to_str(node->hn_method));
+					    hbsdmon_node_method(node));
 					return;
 				}
 			}
@@ -208,7 +311,6 @@ static void
 hbsdmon_heartbeat(hbsdmon_ctx_t *ctx)
 {
 	char sndbuf[512], timebuf[32];
-	pushover_message_t *pmsg;
 	hbsdmon_keyvalue_t *kv;
 	time_t lasthb, curtime;
 	struct tm localt;
@@ -225,19 +327,9 @@ hbsdmon_heartbeat(hbsdmon_ctx_t *ctx)
 	asctime_r(&localt, timebuf);
 
 	memset(sndbuf, 0, sizeof(sndbuf));
-	pmsg = pushover_init_message(NULL);
-	if (pmsg == NULL) {
-		return;
-	}
-	pushover_message_set_title(pmsg, "MONITOR HEARTBEAT");
 	snprintf(sndbuf, sizeof(sndbuf)-1, "%s: Heartbeat at %s\n",
 	    ctx->hc_name, timebuf);
-	pushover_message_set_msg(pmsg, sndbuf);
-	pushover_message_set_dest(pmsg, ctx->hc_dest);
-#ifndef NOSUBMIT
-	pushover_submit_message(ctx->hc_psh_ctx, pmsg);
-#endif
-	pushover_free_message(&pmsg);
+	hbsdmon_notify(ctx, "MONITOR HEARTBEAT", sndbuf);
 
 	hbsdmon_lock_ctx(ctx);
 	ctx->hc_stats.hs_nheartbeats++;
@@ -255,16 +347,30 @@ main_handle_message(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node,
 	case VERB_HEARTBEAT:
 		printf("Main: Got heartbeat from %s (method %s)\n",
 		    node->hn_host,
-		    hbsdmon_method_to_str(node->hn_method));
+		    hbsdmon_node_method(node));
 		break;
 	case VERB_TERM:
 		pthread_join(node->hn_thread->ht_tid, NULL);
+		node->hn_thread->ht_flags |= HBSDMON_THREAD_FAILED;
+		break;
+	case VERB_STATE:
+		node->hn_shared_lastfail = (time_t)msg->htm_uint64;
+		hbsdmon_cluster_publish_state(ctx, node,
+		    node->hn_shared_lastfail);
+		hbsdmon_deps_update(ctx, node);
+		break;
+	case VERB_SUSPECT:
+		hbsdmon_cluster_suspect(ctx, node);
+		break;
+	case VERB_VERDICT:
+		hbsdmon_cluster_verdict(ctx, node, msg->htm_arg,
+		    msg->htm_uint64 != 0);
 		break;
 	default:
 		printf("Main: Got unknown message from %s"
 		    " (method %s)\n",
 		    node->hn_host,
-		    hbsdmon_method_to_str(node->hn_method));
+		    hbsdmon_node_method(node));
 	}
 
 	return (true);
@@ -299,47 +405,118 @@ dispatch_signal(hbsdmon_ctx_t *ctx)
 	}
 }
 
+/*
+ * Tell every worker to exit at once, then give them all one shared
+ * deadline. Probes in flight notice hc_stopping and give up. Threads
+ * still running at the deadline are cancelled, so shutdown takes
+ * about the same time however many nodes there are.
+ */
 static void
 dispatch_term(hbsdmon_ctx_t *ctx)
 {
-	hbsdmon_thread_t *thread, *tthread;
+	hbsdmon_thread_t *thread, *tthread, **threads;
+	zmq_pollitem_t *pollitems;
 	hbsdmon_thread_msg_t msg;
-	zmq_pollitem_t zmqpoll;
+	uint64_t deadline, now;
+	size_t i, npending;
 	int res;
 
 	printf("[*] Main thread: dispatching term.\n");
 
+	ctx->hc_stopping = true;
+
+	pollitems = calloc(ctx->hc_nthreads, sizeof(*pollitems));
+	threads = calloc(ctx->hc_nthreads, sizeof(*threads));
+	if (pollitems == NULL || threads == NULL) {
+		free(pollitems);
+		free(threads);
+		SLIST_FOREACH_SAFE(thread, &(ctx->hc_threads), ht_entry,
+		    tthread) {
+			if ((thread->ht_flags & HBSDMON_THREAD_FAILED) == 0) {
+				pthread_cancel(thread->ht_tid);
+			}
+		}
+		return;
+	}
+
+	npending = 0;
 	SLIST_FOREACH_SAFE(thread, &(ctx->hc_threads), ht_entry,
 	   tthread) {
+		/* Nobody is listening on the other end. */
+		if (thread->ht_flags & HBSDMON_THREAD_FAILED) {
+			continue;
+		}
+
+		/*
+		 * Don't block on a thread that isn't reading. It will
+		 * see hc_stopping instead.
+		 */
 		memset(&msg, 0, sizeof(msg));
 		msg.htm_verb = VERB_TERM;
-		res = zmq_send(thread->ht_zmqsock, &msg,
-		    sizeof(msg), 0);
-		assert(res == sizeof(msg));
+		zmq_send(thread->ht_zmqsock, &msg, sizeof(msg),
+		    ZMQ_DONTWAIT);
 
-		/* Allow the thread one second to clean up. */
-		memset(&zmqpoll, 0, sizeof(zmqpoll));
-		zmqpoll.socket = thread->ht_zmqsock;
-		zmqpoll.events |= ZMQ_POLLIN;
-		zmq_poll(&zmqpoll, 1, 1000);
+		pollitems[npending].socket = thread->ht_zmqsock;
+		pollitems[npending].events = ZMQ_POLLIN;
+		threads[npending] = thread;
+		npending++;
+	}
 
-		memset(&msg, 0, sizeof(msg));
-		res = zmq_recv(thread->ht_zmqsock, &msg,
-		    sizeof(msg), ZMQ_DONTWAIT);
-		if (res != sizeof(msg)) {
-			fprintf(stderr, "[*] Worker thread failed to"
-			    " shutdown gracefully. Terminating.\n");
-			pthread_cancel(thread->ht_tid);
+	deadline = hbsdmon_now_ms() + HBSDMON_TERM_TIMEOUT_MS;
+	while (npending > 0) {
+		now = hbsdmon_now_ms();
+		if (now >= deadline) {
+			break;
+		}
+
+		res = zmq_poll(pollitems, (int)npending,
+		    (long)(deadline - now));
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
 		}
-		pthread_peekjoin_np(thread->ht_tid, NULL);
-		pthread_cancel(thread->ht_tid);
+
+		i = 0;
+		while (i < npending) {
+			if ((pollitems[i].revents & ZMQ_POLLIN) == 0) {
+				i++;
+				continue;
+			}
+
+			memset(&msg, 0, sizeof(msg));
+			res = zmq_recv(pollitems[i].socket, &msg,
+			    sizeof(msg), ZMQ_DONTWAIT);
+			if (res != sizeof(msg) || msg.htm_verb != VERB_TERM) {
+				/* Something sent before it saw TERM. */
+				pollitems[i].revents = 0;
+				i++;
+				continue;
+			}
+
+			pthread_join(threads[i]->ht_tid, NULL);
+			npending--;
+			pollitems[i] = pollitems[npending];
+			threads[i] = threads[npending];
+		}
+	}
+
+	if (npending > 0) {
+		fprintf(stderr, "[*] %zu worker threads failed to shutdown"
+		    " gracefully. Terminating.\n", npending);
 	}
+	for (i = 0; i < npending; i++) {
+		pthread_cancel(threads[i]->ht_tid);
+	}
+
+	free(pollitems);
+	free(threads);
 }
 
 static void
 dispatch_info(hbsdmon_ctx_t *ctx)
 {
-	pushover_message_t *pmsg;
 	char *stats_str;
 
 	hbsdmon_lock_ctx(ctx);
@@ -351,65 +528,6 @@ dispatch_info(hbsdmon_ctx_t *ctx)
 		return;
 	}
 
-	pmsg = pushover_init_message(NULL);
-	if (pmsg == NULL) {
-		free(stats_str);
-		return;
-	}
-	pushover_message_set_title(pmsg, "MONITOR STATS");
-	pushover_message_set_msg(pmsg, stats_str);
-	pushover_message_set_dest(pmsg, ctx->hc_dest);
-#ifndef NOSUBMIT
-	pushover_submit_message(ctx->hc_psh_ctx, pmsg);
-#else
-	fprintf(stderr, "MONITOR STATS:\n%s\n", stats_str);
-#endif
-	pushover_free_message(&pmsg);
+	hbsdmon_notify(ctx, "MONITOR STATS", stats_str);
 	free(stats_str);
 }
-
-static char *
-hbsdmon_stats_to_str(hbsdmon_ctx_t *ctx)
-{
-	struct tm localt;
-	char timebuf[32];
-	time_t heartbeat;
-	struct sbuf *sb;
-	char *ret;
-
-	sb = sbuf_new_auto();
-	if (sb == NULL) {
-		return (NULL);
-	}
-
-	memset(&localt, 0, sizeof(localt));
-	memset(timebuf, 0, sizeof(timebuf));
-	heartbeat = hbsdmon_get_last_heartbeat(ctx);
-	localtime_r(&heartbeat, &localt);
-	asctime_r(&localt, timebuf);
-
-	sbuf_printf(sb, "Monitor name: %s\n", ctx->hc_name);
-	sbuf_printf(sb, "Last heartbeat: %s\n", timebuf);
-
-	sbuf_printf(sb, "Nodes: %zu\n", ctx->hc_nnodes);
-
-	sbuf_printf(sb,
-	    "Heartbeats: %zu\n"
-	    "Errors: %zu\n"
-	    "Successes: %zu\n"
-	    "Poll failures: %zu\n",
-	    ctx->hc_stats.hs_nheartbeats,
-	    ctx->hc_stats.hs_nerrors,
-	    ctx->hc_stats.hs_nsuccess,
-	    ctx->hc_stats.hs_npollfails);
-
-	if (sbuf_finish(sb)) {
-		sbuf_delete(sb);
-		return (NULL);
-	}
-
-	ret = strdup(sbuf_data(sb));
-	sbuf_delete(sb);
-
-	return (ret);
-}
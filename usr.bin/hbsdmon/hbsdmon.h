@@ -13,8 +13,122 @@
 
 #define	HBSDMON_DEFAULT_NAME	"HardenedBSD Monitor"
 
+/*
+ * Number of consecutive successful probes after which a node's
+ * probe interval is relaxed toward its maximum.
+ */
+#define	HBSDMON_STABLE_PROBES	3
+
+/*
+ * A probe that starts, or a main loop wakeup that happens, this many
+ * milliseconds after it was due is counted as late.
+ */
+#define	HBSDMON_LATE_MS		1000
+
+/* How often the main loop wakes up when there's nothing to do. */
+#define	HBSDMON_MAIN_TICK_MS	1000
+
+/*
+ * Latency histograms use power-of-two millisecond buckets: bucket 0
+ * counts samples below 1ms, bucket n counts samples in
+ * [2^(n-1), 2^n) ms and the last bucket counts everything above.
+ */
+#define	HBSDMON_HIST_BUCKETS	16
+
+/*
+ * Size of the buffer notification bodies are assembled in. Pushover
+ * truncates messages at 1024 characters anyway.
+ */
+#define	HBSDMON_MSG_MAX		1024
+
+/*
+ * On shutdown, worker threads get this long, all together, to exit.
+ * Queued notifications then get this long to be submitted before
+ * the rest is spooled.
+ */
+#define	HBSDMON_TERM_TIMEOUT_MS		3000
+#define	HBSDMON_FLUSH_TIMEOUT_MS	2000
+
+/* How often a blocking probe checks whether it should give up. */
+#define	HBSDMON_ABORT_POLL_MS		100
+
+/*
+ * Clustering: peers announce themselves every HBSDMON_CLUSTER_HB_MS
+ * and are considered gone when not heard from for the configured
+ * timeout. Every member is placed on the hash ring this many times.
+ */
+#define	HBSDMON_CLUSTER_HB_MS		1000
+#define	HBSDMON_CLUSTER_TIMEOUT		5
+#define	HBSDMON_CLUSTER_VNODES		64
+#define	HBSDMON_CLUSTER_IDLEN		64
+#define	HBSDMON_CLUSTER_KEYLEN		256
+
+/*
+ * How long to wait for peers to confirm a failure. Peers that haven't
+ * answered by then are left out of the vote.
+ */
+#define	HBSDMON_CONFIRM_TIMEOUT_MS	10000
+
+/*
+ * When a node recovers, the nodes depending on it are re-checked
+ * right away, but no more than one every this many milliseconds.
+ */
+#define	HBSDMON_RECHECK_SPACING_MS	20
+
+/*
+ * The status of every monitored ZFS pool is refreshed in one pass,
+ * at most this often, no matter how many nodes watch the pools.
+ */
+#define	HBSDMON_ZFS_REFRESH_MS		1000
+#define	HBSDMON_ZPOOL_STATELEN		32
+#define	HBSDMON_ZPOOL_MSGIDLEN		16
+
+/*
+ * While the backend delivers ZFS events, pools are only refreshed on
+ * an event, or for reconciliation every this many seconds.
+ */
+#define	HBSDMON_ZFS_RECONCILE		300
+#define	HBSDMON_ZEVENT_CLASSLEN		64
+#define	HBSDMON_ZEVENT_POOLLEN		256
+
+/* Leaf vdevs tracked per pool. Any others are left out. */
+#define	HBSDMON_ZPOOL_VDEVS		32
+#define	HBSDMON_ZPOOL_VDEVLEN		64
+
+/*
+ * Nodes probed through the same plugin that come due within this
+ * many milliseconds of each other are handed to it in one batch.
+ * A batch should be done within HBSDMON_PLUGIN_TIMEOUT_MS.
+ */
+#define	HBSDMON_PLUGIN_GATHER_MS	50
+#define	HBSDMON_PLUGIN_TIMEOUT_MS	2000
+
+/*
+ * EXEC nodes run their command through one of a pool of helper
+ * processes forked at startup, so at most that many commands run at
+ * once. Commands get HBSDMON_EXEC_TIMEOUT seconds unless configured
+ * otherwise. Only the first HBSDMON_EXEC_OUTMAX bytes of their
+ * output are kept. A helper that doesn't answer within the command's
+ * timeout plus HBSDMON_EXEC_GRACE_MS is killed.
+ */
+#define	HBSDMON_EXEC_WORKERS		4
+#define	HBSDMON_EXEC_TIMEOUT		10
+#define	HBSDMON_EXEC_OUTMAX		512
+#define	HBSDMON_EXEC_GRACE_MS		1000
+#define	HBSDMON_EXEC_CMDMAX		4096
+#define	HBSDMON_EXEC_SHELL		"/bin/sh"
+
+/* Thread flags (ht_flags) */
+#define	HBSDMON_THREAD_STARTED	0x1	/* Node initialized, probing */
+#define	HBSDMON_THREAD_FAILED	0x2	/* Thread exited */
+
 struct _hbsdmon_ctx;
 struct _hbsdmon_thread;
+struct _hbsdmon_zpool;
+struct _hbsdmon_plugin;
+struct _hbsdmon_plugin_mod;
+struct sbuf;
+struct ucl_object_s;
 
 typedef enum _hbsdmon_method {
 	METHOD_HTTP,
@@ -25,13 +139,35 @@ typedef enum _hbsdmon_method {
 	METHOD_TOR,
 	METHOD_UDP,
 	METHOD_ZFS,
+	METHOD_EXEC,
+	METHOD_PLUGIN,
 } hbsdmon_method_t;
 
+/*
+ * Phases of a probe, in the order they happen. Not every method goes
+ * through every phase.
+ */
+typedef enum _hbsdmon_phase {
+	PHASE_DNS,
+	PHASE_CONNECT,
+	PHASE_TLS,
+	PHASE_FIRSTBYTE,
+	PHASE_TOTAL,
+	PHASE_MAX,
+} hbsdmon_phase_t;
+
 typedef enum _hbsdmon_thread_msg_verb {
 	VERB_INIT,
 	VERB_FINI,
 	VERB_HEARTBEAT,
 	VERB_TERM,
+	VERB_OWN,
+	VERB_STATE,
+	VERB_SUSPECT,
+	VERB_CONFIRM,
+	VERB_VERDICT,
+	VERB_PAUSE,
+	VERB_PROBE,
 } hbsdmon_thread_msg_verb_t;
 
 typedef struct _hbsdmon_keyvalue {
@@ -46,11 +182,101 @@ typedef struct _hbsdmon_keyvalue_store {
 	SLIST_HEAD(, _hbsdmon_keyvalue)	 hks_store;
 } hbsdmon_keyvalue_store_t;
 
+typedef struct _hbsdmon_hist {
+	uint64_t			 hh_count;
+	uint64_t			 hh_sum;
+	uint64_t			 hh_max;
+	uint64_t			 hh_buckets[HBSDMON_HIST_BUCKETS];
+} hbsdmon_hist_t;
+
+typedef enum _hbsdmon_exec_state {
+	EXEC_EXITED,
+	EXEC_SIGNALED,
+	EXEC_TIMEDOUT,
+	EXEC_FAILED,
+} hbsdmon_exec_state_t;
+
+/*
+ * How an EXEC node's command ended. her_code is the exit status or
+ * the signal that killed it.
+ */
+typedef struct _hbsdmon_exec_result {
+	hbsdmon_exec_state_t		 her_state;
+	int				 her_code;
+	uint32_t			 her_outlen;
+} hbsdmon_exec_result_t;
+
+/*
+ * Timing of the last probe of a node, filled in by the probe engines.
+ * Durations are per phase, in microseconds. hp_valid has bit n set
+ * if phase n was measured. hp_failed is the phase the probe failed
+ * in, or PHASE_MAX.
+ */
+typedef struct _hbsdmon_probe {
+	uint64_t			 hp_phases[PHASE_MAX];
+	uint32_t			 hp_valid;
+	hbsdmon_phase_t			 hp_failed;
+} hbsdmon_probe_t;
+
+/*
+ * A failure confirmation, kept by the main thread. hcf_seq and the
+ * vote counts track a confirmation we asked our peers for. hcf_to and
+ * hcf_reqseq track the last one a peer asked us for.
+ */
+typedef struct _hbsdmon_confirm {
+	uint64_t			 hcf_seq;
+	uint64_t			 hcf_start;
+	size_t				 hcf_ndown;
+	size_t				 hcf_nup;
+	char				 hcf_to[HBSDMON_CLUSTER_IDLEN];
+	uint64_t			 hcf_reqseq;
+} hbsdmon_confirm_t;
+
 typedef struct _hbsdmon_node {
 	char				*hn_host;
 	struct _hbsdmon_thread		*hn_thread;
 	hbsdmon_method_t		 hn_method;
 	hbsdmon_keyvalue_store_t	*hn_kvstore;
+	long				 hn_interval;
+	long				 hn_interval_base;
+	long				 hn_interval_min;
+	long				 hn_interval_max;
+	size_t				 hn_nstable;
+	bool				 hn_failing;
+	hbsdmon_probe_t			 hn_probe;
+	hbsdmon_hist_t			 hn_phases[PHASE_MAX];
+	char				*hn_desc;
+	uint64_t			 hn_desc_gen;
+	const char			*hn_failmsg;
+	time_t				 hn_lastfail;
+	size_t				 hn_index;
+	char				*hn_key;
+	uint32_t			 hn_hash;
+	bool				 hn_owned;
+	bool				 hn_assigned;
+	time_t				 hn_shared_lastfail;
+	bool				 hn_suspect;
+	bool				 hn_simfail;
+	hbsdmon_confirm_t		 hn_confirm;
+	char				*hn_name;
+	char				**hn_depnames;
+	size_t				 hn_ndepnames;
+	struct _hbsdmon_node		**hn_parents;
+	size_t				 hn_nparents;
+	struct _hbsdmon_node		**hn_children;
+	size_t				 hn_nchildren;
+	char				*hn_deps_desc;
+	int				 hn_mark;
+	bool				 hn_unreachable;
+	bool				 hn_paused;
+	struct _hbsdmon_zpool		*hn_zpool;
+	struct _hbsdmon_zfs_limits	*hn_zlimits;
+	struct _hbsdmon_plugin_mod	*hn_plugin;
+	void				*hn_plugin_arg;
+	bool				 hn_plugin_ok;
+	bool				 hn_plugin_done;
+	char				*hn_exec_out;
+	hbsdmon_exec_result_t		 hn_exec_res;
 	SLIST_ENTRY(_hbsdmon_node)	 hn_entry;
 } hbsdmon_node_t;
 
@@ -74,29 +300,285 @@ typedef struct _hbsdmon_thread_msg {
 		hbsdmon_thread_t	*htm_thread;
 		uint64_t		 htm_uint64;
 	};
+	uint64_t			 htm_arg;
 } hbsdmon_thread_msg_t;
 
+typedef struct _hbsdmon_notification {
+	char					*hnt_title;
+	char					*hnt_msg;
+	TAILQ_ENTRY(_hbsdmon_notification)	 hnt_entry;
+} hbsdmon_notification_t;
+
+typedef TAILQ_HEAD(_hbsdmon_notify_queue, _hbsdmon_notification)
+    hbsdmon_notify_queue_t;
+
+/*
+ * Notifications are queued and submitted by a dedicated thread so
+ * that neither the node threads nor the main loop wait on Pushover.
+ */
+typedef struct _hbsdmon_notifier {
+	pthread_t				 hnq_tid;
+	pthread_mutex_t				 hnq_mtx;
+	pthread_cond_t				 hnq_cv;
+	bool					 hnq_running;
+	bool					 hnq_stop;
+	bool					 hnq_done;
+	size_t					 hnq_len;
+	hbsdmon_notify_queue_t			 hnq_queue;
+} hbsdmon_notifier_t;
+
+typedef struct _hbsdmon_member {
+	char				 hm_id[HBSDMON_CLUSTER_IDLEN];
+	uint64_t			 hm_lastseen;
+	bool				 hm_alive;
+	SLIST_ENTRY(_hbsdmon_member)	 hm_entry;
+} hbsdmon_member_t;
+
+typedef struct _hbsdmon_vnode {
+	uint32_t			 hv_hash;
+	hbsdmon_member_t		*hv_member;
+} hbsdmon_vnode_t;
+
+/*
+ * Instances sharing a config split its nodes between them by
+ * consistent hashing of the node's identity. Each instance publishes
+ * heartbeats and node state changes on hcl_pub and subscribes to
+ * every peer on hcl_sub.
+ */
+typedef struct _hbsdmon_cluster {
+	char				*hcl_id;
+	char				*hcl_bind;
+	char				**hcl_peers;
+	size_t				 hcl_npeers;
+	uint64_t			 hcl_timeout;
+	size_t				 hcl_quorum;
+	uint64_t			 hcl_seq;
+	size_t				 hcl_npending;
+	void				*hcl_pub;
+	void				*hcl_sub;
+	uint64_t			 hcl_start;
+	uint64_t			 hcl_lasthb;
+	bool				 hcl_settled;
+	size_t				 hcl_nalive;
+	size_t				 hcl_nowned;
+	hbsdmon_member_t		 hcl_self;
+	hbsdmon_vnode_t			*hcl_ring;
+	size_t				 hcl_nvnodes;
+	SLIST_HEAD(, _hbsdmon_member)	 hcl_members;
+} hbsdmon_cluster_t;
+
+typedef enum _hbsdmon_zscan {
+	ZSCAN_NONE,
+	ZSCAN_SCRUB,
+	ZSCAN_RESILVER,
+} hbsdmon_zscan_t;
+
+/*
+ * Error counts and I/O latency of a leaf vdev. Latencies are means
+ * over the last refresh interval, in microseconds. The hv_*ops and
+ * hv_*sum fields are the backend's running totals to compute them.
+ */
+typedef struct _hbsdmon_vdev {
+	char				 hv_name[HBSDMON_ZPOOL_VDEVLEN];
+	uint64_t			 hv_read_errors;
+	uint64_t			 hv_write_errors;
+	uint64_t			 hv_cksum_errors;
+	uint64_t			 hv_rlat_us;
+	uint64_t			 hv_wlat_us;
+	uint64_t			 hv_rops;
+	uint64_t			 hv_rsum;
+	uint64_t			 hv_wops;
+	uint64_t			 hv_wsum;
+} hbsdmon_vdev_t;
+
+/*
+ * A monitored ZFS pool, shared by every node watching it. The status
+ * and metrics are written by the backend's refresh and are protected
+ * by the ZFS layer's mutex. hzp_handle belongs to the backend.
+ * hzp_frag is -1 when the pool doesn't know its fragmentation.
+ */
+typedef struct _hbsdmon_zpool {
+	char				*hzp_name;
+	void				*hzp_handle;
+	bool				 hzp_found;
+	bool				 hzp_healthy;
+	char				 hzp_state[HBSDMON_ZPOOL_STATELEN];
+	char				 hzp_msgid[HBSDMON_ZPOOL_MSGIDLEN];
+	uint64_t			 hzp_errata;
+	int				 hzp_capacity;
+	int				 hzp_frag;
+	hbsdmon_zscan_t			 hzp_scan;
+	bool				 hzp_scanning;
+	int				 hzp_scan_pct;
+	hbsdmon_vdev_t			 hzp_root;
+	hbsdmon_vdev_t			 hzp_vdevs[HBSDMON_ZPOOL_VDEVS];
+	size_t				 hzp_nvdevs;
+	hbsdmon_hist_t			 hzp_rlat;
+	hbsdmon_hist_t			 hzp_wlat;
+	SLIST_ENTRY(_hbsdmon_zpool)	 hzp_entry;
+} hbsdmon_zpool_t;
+
+/*
+ * Per-node alert thresholds on its pool's metrics. -1 disables one.
+ * hzl_errors applies to the read, write and checksum errors of any
+ * single vdev, hzl_latency_ms to the pool's mean read or write
+ * latency.
+ */
+typedef struct _hbsdmon_zfs_limits {
+	int64_t				 hzl_capacity;
+	int64_t				 hzl_frag;
+	int64_t				 hzl_errors;
+	int64_t				 hzl_latency_ms;
+} hbsdmon_zfs_limits_t;
+
+/*
+ * A ZFS event, as far as we care about it. hze_dropped counts the
+ * events the kernel dropped before this one.
+ */
+typedef struct _hbsdmon_zevent {
+	char				 hze_class[HBSDMON_ZEVENT_CLASSLEN];
+	char				 hze_pool[HBSDMON_ZEVENT_POOLLEN];
+	char				 hze_vdev[HBSDMON_ZPOOL_VDEVLEN];
+	uint64_t			 hze_dropped;
+} hbsdmon_zevent_t;
+
+struct _hbsdmon_zfs;
+
+/*
+ * A source of pool status. hzb_refresh updates every pool in one
+ * pass and is called with the ZFS layer's mutex held.
+ *
+ * Backends that can deliver ZFS events also implement the
+ * hzb_events_* operations. hzb_events_next waits up to the given
+ * number of milliseconds for an event and returns 1 if it got one,
+ * 0 if not and -1 on error. It's called from the event thread
+ * without the mutex held.
+ */
+typedef struct _hbsdmon_zfs_backend {
+	const char			*hzb_name;
+	bool				 (*hzb_open)(struct _hbsdmon_zfs *);
+	void				 (*hzb_close)(struct _hbsdmon_zfs *);
+	void				 (*hzb_refresh)(struct _hbsdmon_zfs *);
+	bool				 (*hzb_events_open)(struct _hbsdmon_zfs *);
+	int				 (*hzb_events_next)(struct _hbsdmon_zfs *,
+					    hbsdmon_zevent_t *, int);
+	void				 (*hzb_events_close)(struct _hbsdmon_zfs *);
+} hbsdmon_zfs_backend_t;
+
+/*
+ * The event thread relays the events it cares about to the main
+ * thread over hz_evsock.
+ */
+typedef struct _hbsdmon_zfs {
+	const hbsdmon_zfs_backend_t	*hz_backend;
+	void				*hz_handle;
+	char				*hz_mockfile;
+	char				*hz_mockevents;
+	pthread_mutex_t			 hz_mtx;
+	uint64_t			 hz_refreshed;
+	uint64_t			 hz_reconcile_ms;
+	bool				 hz_wantevents;
+	bool				 hz_events;
+	int				 hz_evfd;
+	char				 hz_evbuf[512];
+	size_t				 hz_evlen;
+	pthread_t			 hz_evtid;
+	_Atomic bool			 hz_evstop;
+	void				*hz_evsock;
+	size_t				 hz_npools;
+	SLIST_HEAD(, _hbsdmon_zpool)	 hz_pools;
+} hbsdmon_zfs_t;
+
+/* A helper process. hew_pid is -1 once it's gone. */
+typedef struct _hbsdmon_exec_worker {
+	pid_t				 hew_pid;
+	int				 hew_fd;
+	bool				 hew_busy;
+} hbsdmon_exec_worker_t;
+
+/*
+ * The EXEC helper pool. Each worker slot runs one command at a time.
+ * When a slot's helper is gone, its commands are spawned directly by
+ * the probing thread instead.
+ */
+typedef struct _hbsdmon_exec {
+	size_t				 hx_nworkers;
+	hbsdmon_exec_worker_t		*hx_workers;
+	unsigned int			 hx_timeout;
+	unsigned int			 hx_cpu;
+	size_t				 hx_outmax;
+	pthread_mutex_t			 hx_mtx;
+	pthread_cond_t			 hx_cv;
+} hbsdmon_exec_t;
+
+/*
+ * A loaded probe plugin. Node threads that come due queue up in
+ * hpm_pending. The first one waits up to HBSDMON_PLUGIN_GATHER_MS
+ * for the others, then probes the whole batch while the rest wait
+ * for hn_plugin_done.
+ */
+typedef struct _hbsdmon_plugin_mod {
+	char				*hpm_path;
+	void				*hpm_dl;
+	const struct _hbsdmon_plugin	*hpm_plugin;
+	int				 hpm_fd;
+	size_t				 hpm_nnodes;
+	struct _hbsdmon_node		**hpm_pending;
+	size_t				 hpm_npending;
+	pthread_mutex_t			 hpm_mtx;
+	pthread_cond_t			 hpm_cv;
+	SLIST_ENTRY(_hbsdmon_plugin_mod) hpm_entry;
+} hbsdmon_plugin_mod_t;
+
 typedef struct _hbsdmon_stat {
 	size_t				 hs_nheartbeats;
+	size_t				 hs_nprobes;
 	size_t				 hs_nerrors;
 	size_t				 hs_nsuccess;
 	size_t				 hs_npollfails;
+	size_t				 hs_nlateprobes;
+	size_t				 hs_nlatewakes;
+	size_t				 hs_nconfirms;
+	size_t				 hs_nconfirmed;
+	size_t				 hs_nrefuted;
+	size_t				 hs_nzfsrefreshes;
+	size_t				 hs_nzfsevents;
+	size_t				 hs_nplugin_batches;
+	size_t				 hs_nplugin_probes;
+	size_t				 hs_nexecs;
+	size_t				 hs_nexec_spawns;
+	size_t				 hs_nexec_timeouts;
+	hbsdmon_hist_t			 hs_drift;
+	hbsdmon_hist_t			 hs_wakelag;
 } hbsdmon_stat_t;
 
 typedef struct _hbsdmon_ctx {
 	char				*hc_config;
 	char				*hc_dest;
 	char				*hc_name;
+	char				*hc_spool;
 	pushover_ctx_t			*hc_psh_ctx;
 	hbsdmon_keyvalue_store_t	*hc_kvstore;
 	void				*hc_zmq;
 	size_t				 hc_nthreads;
 	size_t				 hc_nnodes;
 	uint64_t			 hc_heartbeat;
+	uint64_t			 hc_generation;
+	size_t				 hc_ndeps;
+	size_t				 hc_nunreachable;
+	uint64_t			 hc_recheck_next;
+	bool				 hc_dryrun;
+	_Atomic bool			 hc_stopping;
 	hbsdmon_stat_t			 hc_stats;
+	hbsdmon_notifier_t		 hc_notifier;
+	hbsdmon_cluster_t		*hc_cluster;
+	hbsdmon_zfs_t			*hc_zfs;
+	size_t				 hc_nplugins;
+	hbsdmon_exec_t			*hc_exec;
 	pthread_mutex_t			 hc_mtx;
 	SLIST_HEAD(, _hbsdmon_node)	 hc_nodes;
 	SLIST_HEAD(, _hbsdmon_thread)	 hc_threads;
+	SLIST_HEAD(, _hbsdmon_plugin_mod) hc_plugins;
 } hbsdmon_ctx_t;
 
 hbsdmon_ctx_t *new_ctx(void);
@@ -104,7 +586,12 @@ pushover_ctx_t *get_psh_ctx(hbsdmon_ctx_t *);
 bool parse_config(hbsdmon_ctx_t *);
 hbsdmon_method_t hbsdmon_str_to_method(const char *);
 const char *hbsdmon_method_to_str(hbsdmon_method_t);
+const char *hbsdmon_node_method(hbsdmon_node_t *);
+const char *hbsdmon_phase_to_str(hbsdmon_phase_t);
+const char *hbsdmon_zscan_to_str(hbsdmon_zscan_t);
 long hbsdmon_get_interval(hbsdmon_node_t *);
+long hbsdmon_get_interval_min(hbsdmon_node_t *);
+long hbsdmon_get_interval_max(hbsdmon_node_t *);
 time_t hbsdmon_get_last_heartbeat(hbsdmon_ctx_t *);
 bool hbsdmon_update_last_heartbeat(hbsdmon_ctx_t *);
 void hbsdmon_lock_ctx(hbsdmon_ctx_t *);
@@ -114,6 +601,33 @@ void hbsdmon_thread_unlock_ctx(hbsdmon_thread_t *);
 void hbsdmon_node_lock_ctx(hbsdmon_node_t *);
 void hbsdmon_node_unlock_ctx(hbsdmon_node_t *);
 void hbsdmon_reset_stats(hbsdmon_ctx_t *);
+void hbsdmon_submit(hbsdmon_ctx_t *, const char *, const char *);
+
+bool hbsdmon_cluster_init(hbsdmon_ctx_t *);
+void hbsdmon_cluster_fini(hbsdmon_ctx_t *);
+void *hbsdmon_cluster_socket(hbsdmon_ctx_t *);
+void hbsdmon_cluster_tick(hbsdmon_ctx_t *);
+void hbsdmon_cluster_recv(hbsdmon_ctx_t *);
+void hbsdmon_cluster_publish_state(hbsdmon_ctx_t *, hbsdmon_node_t *,
+    time_t);
+void hbsdmon_cluster_suspect(hbsdmon_ctx_t *, hbsdmon_node_t *);
+void hbsdmon_cluster_verdict(hbsdmon_ctx_t *, hbsdmon_node_t *,
+    uint64_t, bool);
+
+bool hbsdmon_deps_resolve(hbsdmon_ctx_t *);
+void hbsdmon_deps_update(hbsdmon_ctx_t *, hbsdmon_node_t *);
+
+bool hbsdmon_notify_init(hbsdmon_ctx_t *);
+void hbsdmon_notify(hbsdmon_ctx_t *, const char *, const char *);
+void hbsdmon_notify_fini(hbsdmon_ctx_t *);
+void hbsdmon_notify_replay(hbsdmon_ctx_t *);
+uint64_t hbsdmon_now_ms(void);
+uint64_t hbsdmon_now_us(void);
+void hbsdmon_probe_time(hbsdmon_probe_t *, hbsdmon_phase_t, uint64_t);
+
+char *hbsdmon_stats_to_str(hbsdmon_ctx_t *);
+void hbsdmon_hist_add(hbsdmon_hist_t *, uint64_t);
+void hbsdmon_hist_to_sbuf(struct sbuf *, const char *, hbsdmon_hist_t *);
 
 hbsdmon_node_t *hbsdmon_new_node(void);
 bool hbsdmon_node_init(hbsdmon_node_t *);
@@ -124,8 +638,11 @@ hbsdmon_keyvalue_t *hbsdmon_find_kv_in_node(hbsdmon_node_t *,
     const char *, bool);
 bool hbsdmon_node_thread_init(hbsdmon_thread_t *);
 bool hbsdmon_node_thread_run(hbsdmon_thread_t *);
+void hbsdmon_node_sched_init(hbsdmon_node_t *);
+void hbsdmon_node_adapt_interval(hbsdmon_node_t *, bool);
 hbsdmon_node_t *hbsdmon_find_node_by_zmqsock(hbsdmon_ctx_t *, void *);
 char *hbsdmon_node_to_str(hbsdmon_node_t *);
+const char *hbsdmon_node_desc(hbsdmon_node_t *);
 
 hbsdmon_keyvalue_t *hbsdmon_new_keyvalue(void);
 bool hbsdmon_keyvalue_store(hbsdmon_keyvalue_t *, const char *,
@@ -153,10 +670,42 @@ bool hbsdmon_http_ping(hbsdmon_node_t *);
 
 bool hbsdmon_udp_ping(hbsdmon_node_t *);
 
-bool hbsdmon_zfs_init(hbsdmon_node_t *);
+hbsdmon_zfs_t *hbsdmon_zfs_new(const char *);
+bool hbsdmon_zfs_add_pool(hbsdmon_ctx_t *, hbsdmon_node_t *,
+    const char *);
+bool hbsdmon_zfs_init(hbsdmon_ctx_t *);
+void hbsdmon_zfs_fini(hbsdmon_ctx_t *);
+void *hbsdmon_zfs_socket(hbsdmon_ctx_t *);
+void hbsdmon_zfs_recv(hbsdmon_ctx_t *);
 bool hbsdmon_zfs_status(hbsdmon_node_t *);
+void hbsdmon_zfs_to_sbuf(hbsdmon_node_t *, struct sbuf *);
+void hbsdmon_zfs_stats_to_sbuf(hbsdmon_ctx_t *, struct sbuf *);
+
+#ifndef WITHOUT_LIBZFS
+extern const hbsdmon_zfs_backend_t hbsdmon_zfs_libzfs;
+#endif
+extern const hbsdmon_zfs_backend_t hbsdmon_zfs_mock;
+
+hbsdmon_exec_t *hbsdmon_exec_new(void);
+bool hbsdmon_exec_init(hbsdmon_ctx_t *);
+void hbsdmon_exec_fini(hbsdmon_ctx_t *);
+bool hbsdmon_exec_ping(hbsdmon_node_t *);
+void hbsdmon_exec_to_sbuf(hbsdmon_node_t *, struct sbuf *);
+
+bool hbsdmon_plugin_load(hbsdmon_ctx_t *, const char *);
+hbsdmon_plugin_mod_t *hbsdmon_plugin_find(hbsdmon_ctx_t *,
+    const char *);
+bool hbsdmon_plugin_add_node(hbsdmon_plugin_mod_t *, hbsdmon_node_t *,
+    const struct ucl_object_s *);
+void hbsdmon_plugin_fini(hbsdmon_ctx_t *);
+bool hbsdmon_plugin_probe(hbsdmon_node_t *);
+int hbsdmon_plugin_desc(hbsdmon_node_t *, char *, size_t);
+void hbsdmon_plugin_recv(hbsdmon_ctx_t *, hbsdmon_plugin_mod_t *);
 
 bool hbsdmon_thread_init(hbsdmon_ctx_t *);
+bool hbsdmon_thread_send(hbsdmon_thread_t *, hbsdmon_thread_msg_t *);
+void hbsdmon_node_tell(hbsdmon_node_t *, hbsdmon_thread_msg_verb_t,
+    uint64_t, uint64_t);
 void hbsdmon_node_cleanup(hbsdmon_node_t *);
 
 #endif /* !_HBSDMON_H */
@@ -0,0 +1,114 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _HBSDMON_PLUGIN_H
+#define _HBSDMON_PLUGIN_H
+
+/*
+ * The interface between hbsdmon and probe plugins. A plugin is a
+ * shared object listed in the configuration's plugins array. It
+ * exports a hbsdmon_plugin_t named HBSDMON_PLUGIN_SYMBOL, whose
+ * hp_abi must be HBSDMON_PLUGIN_ABI. Nodes whose method matches the
+ * plugin's hp_method are probed through it.
+ *
+ * Plugins only see what is declared here, never hbsdmon's own
+ * structures, so they keep working across hbsdmon releases until
+ * HBSDMON_PLUGIN_ABI changes.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ucl.h>
+
+#define	HBSDMON_PLUGIN_ABI	1
+#define	HBSDMON_PLUGIN_SYMBOL	"hbsdmon_plugin"
+
+/* Probe phases, as in hbsdmon's own probe timings. */
+#define	HBSDMON_PLUGIN_PHASE_DNS	0
+#define	HBSDMON_PLUGIN_PHASE_CONNECT	1
+#define	HBSDMON_PLUGIN_PHASE_TLS	2
+#define	HBSDMON_PLUGIN_PHASE_FIRSTBYTE	3
+#define	HBSDMON_PLUGIN_PHASE_TOTAL	4
+#define	HBSDMON_PLUGIN_PHASES		5
+
+/*
+ * One node to probe. hpt_host and hpt_arg are set by hbsdmon. The
+ * plugin sets the rest: hpt_ok, the durations of the phases it
+ * measured in microseconds, with bit n of hpt_valid set for phase
+ * n, and the phase a failed probe failed in.
+ */
+typedef struct _hbsdmon_plugin_target {
+	const char			*hpt_host;
+	void				*hpt_arg;
+	bool				 hpt_ok;
+	int				 hpt_failed;
+	uint32_t			 hpt_valid;
+	uint64_t			 hpt_phases[HBSDMON_PLUGIN_PHASES];
+} hbsdmon_plugin_target_t;
+
+/*
+ * hp_probe is required. Everything else may be NULL.
+ *
+ * hp_init:	Called once when the plugin is loaded. Must not start
+ *		threads, as hbsdmon may still fork afterwards.
+ * hp_fini:	Called once on shutdown, after every hp_free.
+ * hp_parse:	Validate a node's configuration object and return,
+ *		through the last argument, the state hbsdmon passes
+ *		back as hpt_arg. Returns false on a bad configuration.
+ * hp_free:	Free what hp_parse returned.
+ * hp_desc:	Describe a node's target in one line, e.g. "port 22".
+ *		Shown in alerts and used to tell nodes on one host
+ *		apart in a cluster.
+ * hp_probe:	Probe every target in the array, filling in its
+ *		results. Should return within the given number of
+ *		milliseconds. May be called from several threads at
+ *		once, with different targets.
+ * hp_fd:	A descriptor hbsdmon's event loop watches. When it is
+ *		readable, hp_ready is called.
+ * hp_ready:	Store up to the given number of hpt_arg values whose
+ *		nodes should be probed right away in the array. A NULL
+ *		value stands for every node. Returns the number
+ *		stored. Called from the event loop, so it must not
+ *		block.
+ */
+typedef struct _hbsdmon_plugin {
+	uint32_t			 hp_abi;
+	const char			*hp_method;
+	bool				(*hp_init)(void);
+	void				(*hp_fini)(void);
+	bool				(*hp_parse)(const char *,
+					    const ucl_object_t *, void **);
+	void				(*hp_free)(void *);
+	int				(*hp_desc)(void *, char *, size_t);
+	void				(*hp_probe)(hbsdmon_plugin_target_t *,
+					    size_t, uint64_t);
+	int				(*hp_fd)(void);
+	size_t				(*hp_ready)(void **, size_t);
+} hbsdmon_plugin_t;
+
+#endif /* !_HBSDMON_PLUGIN_H */
@@ -25,6 +25,9 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,17 +37,24 @@
 #include <sys/socket.h>
 #include <netdb.h>
 
+#include <curl/curl.h>
 #include <ucl.h>
 
 #include "hbsdmon.h"
 
 static size_t hbsdmon_curl_write_data(void *, size_t,
     size_t, void *);
+static void hbsdmon_http_phases(CURL *, CURLcode, hbsdmon_node_t *);
+static int hbsdmon_curl_progress(void *, curl_off_t, curl_off_t,
+    curl_off_t, curl_off_t);
+static bool hbsdmon_tcp_connect(hbsdmon_node_t *, int,
+    const struct sockaddr *, socklen_t);
 
 bool
 hbsdmon_tcp_ping(hbsdmon_node_t *node)
 {
 	struct addrinfo hints, *servinfo, *servp;
+	uint64_t start, phasestart;
 	hbsdmon_keyvalue_t *kv;
 	char buf[512];
 	int port, res, sockfd;
@@ -69,12 +79,21 @@ hbsdmon_tcp_ping(hbsdmon_node_t *node)
 	hints.ai_family = addrfam;
 	hints.ai_socktype = SOCK_STREAM;
 
+	start = hbsdmon_now_us();
+	node->hn_probe.hp_failed = PHASE_DNS;
+
 	servinfo = NULL;
 	res = getaddrinfo(node->hn_host, buf, &hints, &servinfo);
+	phasestart = hbsdmon_now_us();
+	hbsdmon_probe_time(&(node->hn_probe), PHASE_DNS, phasestart - start);
 	if (res) {
+		hbsdmon_probe_time(&(node->hn_probe), PHASE_TOTAL,
+		    phasestart - start);
 		return (false);
 	}
 
+	/* Connect time covers every address tried. */
+	node->hn_probe.hp_failed = PHASE_CONNECT;
 	ret = false;
 	for (servp = servinfo; servp != NULL; servp = servp->ai_next) {
 		sockfd = socket(servp->ai_family, servp->ai_socktype,
@@ -83,22 +102,87 @@ hbsdmon_tcp_ping(hbsdmon_node_t *node)
 			continue;
 		}
 
-		if (connect(sockfd, servp->ai_addr,
+		if (!hbsdmon_tcp_connect(node, sockfd, servp->ai_addr,
 		    servp->ai_addrlen)) {
 			close(sockfd);
 			continue;
 		}
 
 		close(sockfd);
+		node->hn_probe.hp_failed = PHASE_MAX;
 		ret = true;
 		break;
 	}
 
+	hbsdmon_probe_time(&(node->hn_probe), PHASE_CONNECT,
+	    hbsdmon_now_us() - phasestart);
+	hbsdmon_probe_time(&(node->hn_probe), PHASE_TOTAL,
+	    hbsdmon_now_us() - start);
+
 end:
 	freeaddrinfo(servinfo);
 	return (ret);
 }
 
+/*
+ * Connect without blocking, so the connection attempt can be
+ * abandoned when we're shutting down. The kernel's connect timeout
+ * still applies.
+ */
+static bool
+hbsdmon_tcp_connect(hbsdmon_node_t *node, int sockfd,
+    const struct sockaddr *addr, socklen_t addrlen)
+{
+	struct pollfd pfd;
+	socklen_t errlen;
+	int error, flags;
+
+	flags = fcntl(sockfd, F_GETFL);
+	if (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK)) {
+		return (false);
+	}
+
+	if (connect(sockfd, addr, addrlen) == 0) {
+		return (true);
+	}
+
+	if (errno != EINPROGRESS) {
+		return (false);
+	}
+
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.fd = sockfd;
+	pfd.events = POLLOUT;
+
+	while (true) {
+		if (node->hn_thread->ht_ctx->hc_stopping) {
+			return (false);
+		}
+
+		switch (poll(&pfd, 1, HBSDMON_ABORT_POLL_MS)) {
+		case -1:
+			if (errno == EINTR) {
+				continue;
+			}
+			return (false);
+		case 0:
+			continue;
+		default:
+			break;
+		}
+
+		break;
+	}
+
+	error = 0;
+	errlen = sizeof(error);
+	if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &errlen)) {
+		return (false);
+	}
+
+	return (error == 0);
+}
+
 bool
 hbsdmon_http_ping(hbsdmon_node_t *node)
 {
@@ -113,20 +197,98 @@ hbsdmon_http_ping(hbsdmon_node_t *node)
 		return (false);
 	}
 
-	snprintf(url, sizeof(url)-1, "http://%s/", node->hn_host);
+	snprintf(url, sizeof(url)-1, "%s://%s/",
+	    node->hn_method == METHOD_HTTPS ? "https" : "http",
+	    node->hn_host);
 	curl_easy_setopt(curl, CURLOPT_URL, url);
 	curl_easy_setopt(curl, CURLOPT_NOBODY, 1);
-	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1);
+	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
+	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION,
+	    hbsdmon_curl_progress);
+	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, node);
 	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
 	curl_easy_setopt(curl, CURLOPT_STDERR, NULL);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION,
 	    hbsdmon_curl_write_data);
 	curlcode = curl_easy_perform(curl);
 
+	hbsdmon_http_phases(curl, curlcode, node);
+
 	curl_easy_cleanup(curl);
 	return (curlcode == CURLE_OK);
 }
 
+/*
+ * curl reports each phase as the time elapsed from the start of the
+ * transfer until the end of that phase. Turn those into per-phase
+ * durations, and work out which phase a failed transfer died in.
+ */
+static void
+hbsdmon_http_phases(CURL *curl, CURLcode curlcode, hbsdmon_node_t *node)
+{
+	double dns, conn, tls, firstbyte, total;
+	hbsdmon_probe_t *probe;
+
+	probe = &(node->hn_probe);
+
+	dns = conn = tls = firstbyte = total = 0;
+	curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &dns);
+	curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &conn);
+	curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &tls);
+	curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &firstbyte);
+	curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total);
+
+	hbsdmon_probe_time(probe, PHASE_DNS, dns * 1000000);
+	if (conn > 0) {
+		hbsdmon_probe_time(probe, PHASE_CONNECT,
+		    (conn - dns) * 1000000);
+	}
+	if (tls > 0) {
+		hbsdmon_probe_time(probe, PHASE_TLS, (tls - conn) * 1000000);
+	}
+	if (firstbyte > 0) {
+		hbsdmon_probe_time(probe, PHASE_FIRSTBYTE,
+		    (firstbyte - (tls > 0 ? tls : conn)) * 1000000);
+	}
+	hbsdmon_probe_time(probe, PHASE_TOTAL, total * 1000000);
+
+	switch (curlcode) {
+	case CURLE_OK:
+		probe->hp_failed = PHASE_MAX;
+		break;
+	case CURLE_COULDNT_RESOLVE_HOST:
+		probe->hp_failed = PHASE_DNS;
+		break;
+	case CURLE_SSL_CONNECT_ERROR:
+	case CURLE_PEER_FAILED_VERIFICATION:
+		probe->hp_failed = PHASE_TLS;
+		break;
+	default:
+		if (conn == 0) {
+			probe->hp_failed = PHASE_CONNECT;
+		} else if (node->hn_method == METHOD_HTTPS && tls == 0) {
+			probe->hp_failed = PHASE_TLS;
+		} else {
+			probe->hp_failed = PHASE_FIRSTBYTE;
+		}
+		break;
+	}
+}
+
+/*
+ * curl calls this at least once a second during a transfer. Abort
+ * the transfer when we're shutting down.
+ */
+static int
+hbsdmon_curl_progress(void *usrp, curl_off_t dltotal, curl_off_t dlnow,
+    curl_off_t ultotal, curl_off_t ulnow)
+{
+	hbsdmon_node_t *node;
+
+	node = usrp;
+	return (node->hn_thread->ht_ctx->hc_stopping ? 1 : 0);
+}
+
 static size_t hbsdmon_curl_write_data(void *buffer, size_t sz,
     size_t nmemb, void *usrp)
 {
@@ -43,6 +43,13 @@ static void hbsdmon_node_success(hbsdmon_thread_t *);
 static void hbsdmon_node_notify(hbsdmon_node_t *,
     hbsdmon_thread_msg_t *);
 static char *hbsdmon_node_port(hbsdmon_node_t *);
+static void hbsdmon_node_record_probe(hbsdmon_node_t *);
+static void hbsdmon_node_probe_to_sbuf(hbsdmon_node_t *,
+    struct sbuf *);
+static uint64_t hbsdmon_node_first_probe(hbsdmon_thread_t *);
+static void hbsdmon_node_share_state(hbsdmon_thread_t *);
+static bool hbsdmon_node_suspect(hbsdmon_thread_t *);
+static void hbsdmon_node_confirm_probe(hbsdmon_thread_t *, uint64_t);
 
 hbsdmon_node_t *
 hbsdmon_new_node(void)
@@ -60,6 +67,9 @@ hbsdmon_new_node(void)
 		return (NULL);
 	}
 
+	/* Without a cluster, every node is ours. */
+	res->hn_owned = res->hn_assigned = true;
+
 	return (res);
 }
 
@@ -67,15 +77,7 @@ bool
 hbsdmon_node_init(hbsdmon_node_t *node)
 {
 
-	switch (node->hn_method) {
-	case METHOD_ZFS:
-		if (!hbsdmon_zfs_init(node)) {
-			return (false);
-		}
-	default:
-		break;
-	}
-
+	/* ZFS pools are opened for all nodes by hbsdmon_zfs_init(). */
 	return (true);
 }
 
@@ -107,15 +109,26 @@ bool
 hbsdmon_node_thread_run(hbsdmon_thread_t *thread)
 {
 	hbsdmon_thread_msg_t tmsg;
-	pushover_message_t *pmsg;
 	zmq_pollitem_t pollitem;
-	hbsdmon_keyvalue_t *kv;
-	char sndbuf[512];
+	uint64_t due, now, lag;
 	long timeout;
 	int nevents, res;
 
+	/*
+	 * Probes are scheduled against absolute deadlines so that the
+	 * time spent probing (or notifying) doesn't push every later
+	 * probe back. First probes are spread evenly over one interval
+	 * so that nodes started together don't probe in lockstep.
+	 */
+	due = hbsdmon_now_ms() + hbsdmon_node_first_probe(thread);
+
 	while (true) {
-		timeout = hbsdmon_get_interval(thread->ht_node) * 1000;
+		if (thread->ht_ctx->hc_stopping) {
+			return (true);
+		}
+
+		now = hbsdmon_now_ms();
+		timeout = (due > now) ? (long)(due - now) : 0;
 
 		memset(&pollitem, 0, sizeof(pollitem));
 		pollitem.socket = thread->ht_zmqtsock;
@@ -134,6 +147,56 @@ hbsdmon_node_thread_run(hbsdmon_thread_t *thread)
 			switch (tmsg.htm_verb) {
 			case VERB_INIT:
 				break;
+			case VERB_OWN:
+				if (tmsg.htm_uint64 != 0 &&
+				    thread->ht_node->hn_owned == false) {
+					/* Taken over. Probe right away. */
+					due = hbsdmon_now_ms();
+				}
+				thread->ht_node->hn_owned =
+				    (tmsg.htm_uint64 != 0);
+				break;
+			case VERB_STATE:
+				/* Alert state replicated by the owner. */
+				thread->ht_node->hn_lastfail =
+				    (time_t)tmsg.htm_uint64;
+				break;
+			case VERB_CONFIRM:
+				hbsdmon_node_confirm_probe(thread,
+				    tmsg.htm_uint64);
+				break;
+			case VERB_PROBE:
+				/* Something happened. Don't wait. */
+				due = hbsdmon_now_ms();
+				break;
+			case VERB_PAUSE:
+				/*
+				 * Every node this one depends on is down,
+				 * or reachable again. Re-check at the
+				 * time the main thread picked.
+				 */
+				if (tmsg.htm_uint64 == 0 &&
+				    thread->ht_node->hn_paused) {
+					due = hbsdmon_now_ms() + tmsg.htm_arg;
+				}
+				thread->ht_node->hn_paused =
+				    (tmsg.htm_uint64 != 0);
+				break;
+			case VERB_VERDICT:
+				if (thread->ht_node->hn_suspect == false ||
+				    thread->ht_node->hn_paused) {
+					/*
+					 * Recovered in the meantime, or
+					 * covered by a parent's alert.
+					 */
+					thread->ht_node->hn_suspect = false;
+					break;
+				}
+				thread->ht_node->hn_suspect = false;
+				if (tmsg.htm_uint64 != 0) {
+					hbsdmon_node_fail(thread);
+				}
+				break;
 			case VERB_TERM:
 			case VERB_FINI:
 			default:
@@ -154,33 +217,92 @@ hbsdmon_node_thread_run(hbsdmon_thread_t *thread)
 			continue;
 		}
 
+		now = hbsdmon_now_ms();
+		if (now < due) {
+			/* Woken up by a message. Not time yet. */
+			continue;
+		}
+
+		if (thread->ht_node->hn_owned == false) {
+			/* Another cluster member probes this node. */
+			due = now + thread->ht_node->hn_interval * 1000;
+			continue;
+		}
+
+		if (thread->ht_node->hn_paused) {
+			/* Unreachable. Wait for VERB_PAUSE to resume. */
+			due = now + thread->ht_node->hn_interval * 1000;
+			continue;
+		}
+
+		/*
+		 * Record how late this probe starts. Lateness comes from
+		 * a slow previous probe or notification, or from the
+		 * host being overloaded.
+		 */
+		lag = now - due;
+		hbsdmon_thread_lock_ctx(thread);
+		thread->ht_ctx->hc_stats.hs_nprobes++;
+		hbsdmon_hist_add(&(thread->ht_ctx->hc_stats.hs_drift), lag);
+		if (lag >= HBSDMON_LATE_MS) {
+			thread->ht_ctx->hc_stats.hs_nlateprobes++;
+		}
+		hbsdmon_thread_unlock_ctx(thread);
+
+		/* Don't try to catch up on a whole missed interval. */
+		if (lag > (uint64_t)thread->ht_node->hn_interval * 1000) {
+			due = now;
+		}
+
 		res = hbsdmon_node_ping(thread->ht_ctx,
 			thread->ht_node);
+		hbsdmon_node_adapt_interval(thread->ht_node, res);
+		due += thread->ht_node->hn_interval * 1000;
+
 		if (res == false) {
-			hbsdmon_node_fail(thread);
+			if (hbsdmon_node_suspect(thread) == false) {
+				hbsdmon_node_fail(thread);
+			}
 			continue;
 		}
 
+		thread->ht_node->hn_suspect = false;
+
 		hbsdmon_thread_lock_ctx(thread);
 		thread->ht_ctx->hc_stats.hs_nsuccess++;
 		hbsdmon_thread_unlock_ctx(thread);
 
-		/*
-		* Ping successful. Clear the last
-		* fail time if it exists.
-		*/
-		kv = hbsdmon_find_kv_in_node(thread->ht_node,
-		    "lastfail", true);
-		if (kv != NULL) {
+		/* Ping successful. Notify if the node was down. */
+		if (thread->ht_node->hn_lastfail != 0) {
 			hbsdmon_node_success(thread);
-			hbsdmon_free_kv(hbsdmon_node_kv(
-			    thread->ht_node), &kv, true);
+			thread->ht_node->hn_lastfail = 0;
+			hbsdmon_node_share_state(thread);
 		}
 	}
 
 	return (true);
 }
 
+/*
+ * Milliseconds until the first probe of a node: the node's share of
+ * its interval, by its position in the config.
+ */
+static uint64_t
+hbsdmon_node_first_probe(hbsdmon_thread_t *thread)
+{
+	hbsdmon_node_t *node;
+	size_t nnodes;
+
+	node = thread->ht_node;
+	nnodes = thread->ht_ctx->hc_nnodes;
+	if (nnodes == 0) {
+		return (0);
+	}
+
+	return ((uint64_t)node->hn_interval * 1000 * node->hn_index /
+	    nnodes);
+}
+
 hbsdmon_node_t *
 hbsdmon_find_node_by_zmqsock(hbsdmon_ctx_t *ctx, void *sock)
 {
@@ -216,180 +338,354 @@ hbsdmon_node_debug_print(hbsdmon_node_t *node)
 static bool
 hbsdmon_node_ping(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node)
 {
+	bool res;
+
+	memset(&(node->hn_probe), 0, sizeof(node->hn_probe));
+	node->hn_probe.hp_failed = PHASE_MAX;
+
+	if (node->hn_simfail) {
+		node->hn_probe.hp_failed = PHASE_CONNECT;
+		return (false);
+	}
 
 	switch (node->hn_method) {
 	case METHOD_HTTP:
-		return (hbsdmon_http_ping(node));
+	case METHOD_HTTPS:
+		res = hbsdmon_http_ping(node);
+		break;
 	case METHOD_TCP:
-		return (hbsdmon_tcp_ping(node));
+		res = hbsdmon_tcp_ping(node);
+		break;
 	case METHOD_UDP:
-		return (hbsdmon_udp_ping(node));
+		res = hbsdmon_udp_ping(node);
+		break;
 	case METHOD_ZFS:
-		return (hbsdmon_zfs_status(node));
+		res = hbsdmon_zfs_status(node);
+		break;
+	case METHOD_EXEC:
+		res = hbsdmon_exec_ping(node);
+		break;
+	case METHOD_PLUGIN:
+		res = hbsdmon_plugin_probe(node);
+		break;
 	default:
-		return (true);
+		res = true;
+		break;
 	}
+
+	hbsdmon_node_record_probe(node);
+
+	return (res);
 }
 
+/*
+ * Fold the phase timings of the last probe into the node's phase
+ * histograms.
+ */
 static void
-hbsdmon_node_fail(hbsdmon_thread_t *thread)
+hbsdmon_node_record_probe(hbsdmon_node_t *node)
 {
-	time_t lastfail, tlastfail;
-	hbsdmon_thread_msg_t tmsg;
-	pushover_message_t *pmsg;
-	hbsdmon_keyvalue_t *kv;
-	struct sbuf *sb;
-	char *nodestr;
-	long interval;
-
-	/*
-	 * This is used for determining the next ping. Value should be
-	 * one less than the primary interval to properly determine
-	 * next ping time.
-	 */
-	interval = hbsdmon_get_interval(thread->ht_node) - 1;
-
-	kv = hbsdmon_find_kv_in_node(thread->ht_node,
-	    "lastfail", true);
+	hbsdmon_phase_t phase;
 
-	lastfail = 0;
-	if (kv != NULL) {
-		lastfail = hbsdmon_keyvalue_to_time(kv);
-		/* XXX make this dynamic */
-		lastfail = time(NULL) - lastfail;
-		if (lastfail > interval && lastfail < 7200) {
-			return;
+	for (phase = 0; phase < PHASE_MAX; phase++) {
+		if ((node->hn_probe.hp_valid & (1 << phase)) == 0) {
+			continue;
 		}
-		hbsdmon_free_kv(hbsdmon_node_kv(thread->ht_node),
-		    &kv, true);
+		hbsdmon_hist_add(&(node->hn_phases[phase]),
+		    node->hn_probe.hp_phases[phase] / 1000);
 	}
+}
 
-	lastfail = time(NULL);
-	kv = hbsdmon_new_keyvalue();
-	if (kv == NULL) {
-		return;
-	}
-	hbsdmon_keyvalue_store(kv, "lastfail",
-		&lastfail, sizeof(lastfail));
-	hbsdmon_node_append_kv(thread->ht_node, kv);
+/*
+ * Describe where the time of the last probe went: for each measured
+ * phase the last duration, and the mean and max over the node's
+ * lifetime.
+ */
+static void
+hbsdmon_node_probe_to_sbuf(hbsdmon_node_t *node, struct sbuf *sb)
+{
+	hbsdmon_phase_t phase;
+	hbsdmon_hist_t *hist;
 
-	sb = sbuf_new_auto();
-	if (sb == NULL) {
+	if (node->hn_probe.hp_valid == 0) {
 		return;
 	}
 
-	nodestr = hbsdmon_node_to_str(thread->ht_node);
-	if (nodestr == NULL) {
-		goto end;
+	sbuf_cat(sb, "\nProbe timing (last / mean / max):\n");
+	for (phase = 0; phase < PHASE_MAX; phase++) {
+		if ((node->hn_probe.hp_valid & (1 << phase)) == 0) {
+			continue;
+		}
+		hist = &(node->hn_phases[phase]);
+		sbuf_printf(sb, "%s:\t%.1f / %ju / %ju ms%s\n",
+		    hbsdmon_phase_to_str(phase),
+		    (double)node->hn_probe.hp_phases[phase] / 1000,
+		    (uintmax_t)(hist->hh_count ?
+		    hist->hh_sum / hist->hh_count : 0),
+		    (uintmax_t)hist->hh_max,
+		    node->hn_probe.hp_failed == phase ? " (failed)" : "");
 	}
+}
 
-	if (sbuf_cat(sb, nodestr)) {
-		goto end;
-	}
+/*
+ * Notifications are assembled from the node's cached description in
+ * a fixed buffer on the stack, so a burst of failures doesn't
+ * allocate or walk the kv stores.
+ */
+static void
+hbsdmon_node_fail(hbsdmon_thread_t *thread)
+{
+	char body[HBSDMON_MSG_MAX];
+	hbsdmon_node_t *node;
+	const char *desc;
+	struct sbuf sb;
+	time_t now;
 
-	kv = hbsdmon_find_kv_in_node(thread->ht_node,
-	    "failmsg", true);
+	node = thread->ht_node;
+	now = time(NULL);
 
-	if (kv != NULL) {
-		sbuf_printf(sb, "\n%s", hbsdmon_keyvalue_to_str(kv));
+	if (node->hn_lastfail != 0) {
+		/*
+		 * The node is already known to be down. Don't notify
+		 * again until two hours have passed. This must not
+		 * depend on the probe interval, which shrinks while the
+		 * node is failing.
+		 *
+		 * XXX make this dynamic
+		 */
+		if (now - node->hn_lastfail < 7200) {
+			return;
+		}
 	}
 
-	pmsg = pushover_init_message(NULL);
-	if (pmsg == NULL) {
+	node->hn_lastfail = now;
+	hbsdmon_node_share_state(thread);
+
+	desc = hbsdmon_node_desc(node);
+	if (desc == NULL) {
 		goto end;
 	}
 
-	if (sbuf_finish(sb)) {
-		goto end;
+	sbuf_new(&sb, body, sizeof(body), SBUF_FIXEDLEN);
+	sbuf_cat(&sb, desc);
+	if (node->hn_failmsg != NULL) {
+		sbuf_printf(&sb, "\n%s", node->hn_failmsg);
+	}
+	hbsdmon_node_probe_to_sbuf(node, &sb);
+	if (node->hn_method == METHOD_ZFS) {
+		hbsdmon_zfs_to_sbuf(node, &sb);
+	}
+	if (node->hn_method == METHOD_EXEC) {
+		hbsdmon_exec_to_sbuf(node, &sb);
+	}
+	if (node->hn_deps_desc != NULL) {
+		sbuf_cat(&sb, node->hn_deps_desc);
 	}
 
-#ifndef NOSUBMIT
-	pushover_message_set_dest(pmsg, thread->ht_ctx->hc_dest);
-	pushover_message_set_title(pmsg, "NODE FAILURE");
-	pushover_message_set_msg(pmsg, sbuf_data(sb));
-	pushover_submit_message(thread->ht_ctx->hc_psh_ctx, pmsg);
-#else
-	fprintf(stderr, "NODE FAILURE:\n%s\n", sbuf_data(sb));
-#endif
+	/* An overlong body is truncated, which is fine. */
+	sbuf_finish(&sb);
 
-end:
+	hbsdmon_notify(thread->ht_ctx, "NODE FAILURE", sbuf_data(&sb));
+	sbuf_delete(&sb);
 
+end:
 	hbsdmon_thread_lock_ctx(thread);
 	thread->ht_ctx->hc_stats.hs_nerrors++;
 	hbsdmon_thread_unlock_ctx(thread);
+}
 
-	sbuf_delete(sb);
-	free(nodestr);
-	if (pmsg != NULL) {
-		pushover_free_message(&pmsg);
-	}
+/*
+ * Send a message to the main thread.
+ */
+static void
+hbsdmon_node_notify(hbsdmon_node_t *node, hbsdmon_thread_msg_t *msg)
+{
+	int res;
+
+	res = zmq_send(node->hn_thread->ht_zmqtsock, msg, sizeof(*msg), 0);
+	assert(res == sizeof(*msg));
 }
 
+/*
+ * Tell the main thread about the node's alert state. It replicates
+ * it to the other cluster members and pauses or resumes the nodes
+ * depending on this one.
+ */
 static void
-hbsdmon_node_success(hbsdmon_thread_t *thread)
+hbsdmon_node_share_state(hbsdmon_thread_t *thread)
 {
-	pushover_message_t *pmsg;
-	char *nodestr;
+	hbsdmon_thread_msg_t msg;
 
-	pmsg = pushover_init_message(NULL);
-	if (pmsg == NULL) {
-		return;
+	memset(&msg, 0, sizeof(msg));
+	msg.htm_verb = VERB_STATE;
+	msg.htm_uint64 = (uint64_t)thread->ht_node->hn_lastfail;
+	hbsdmon_node_notify(thread->ht_node, &msg);
+}
+
+/*
+ * With a cluster quorum above one, a failure isn't alerted on until
+ * enough peers confirm it. Ask the main thread to collect their
+ * verdicts and return true while that's going on. The answer comes
+ * back as VERB_VERDICT. A node that is already known to be down
+ * needs no confirmation, and peers can't see our ZFS pools.
+ */
+static bool
+hbsdmon_node_suspect(hbsdmon_thread_t *thread)
+{
+	hbsdmon_thread_msg_t msg;
+	hbsdmon_node_t *node;
+
+	node = thread->ht_node;
+	if (thread->ht_ctx->hc_cluster == NULL ||
+	    thread->ht_ctx->hc_cluster->hcl_quorum <= 1 ||
+	    node->hn_method == METHOD_ZFS ||
+	    node->hn_lastfail != 0) {
+		return (false);
 	}
 
-	nodestr = hbsdmon_node_to_str(thread->ht_node);
-	if (nodestr == NULL) {
-		pushover_free_message(&pmsg);
-		return;
+	if (node->hn_suspect) {
+		return (true);
 	}
 
-#ifndef NOSUBMIT
-	pushover_message_set_dest(pmsg, thread->ht_ctx->hc_dest);
-	pushover_message_set_title(pmsg, "NODE ONLINE");
-	pushover_message_set_msg(pmsg, nodestr);
-	pushover_submit_message(thread->ht_ctx->hc_psh_ctx, pmsg);
-#else
-	fprintf(stderr, "NODE ONLINE:\n%s\n", nodestr);
-#endif
+	node->hn_suspect = true;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.htm_verb = VERB_SUSPECT;
+	hbsdmon_node_notify(node, &msg);
+
+	return (true);
+}
+
+/*
+ * A peer asks us to confirm a failure. Probe right away, owned or
+ * not, and send our verdict back through the main thread.
+ */
+static void
+hbsdmon_node_confirm_probe(hbsdmon_thread_t *thread, uint64_t seq)
+{
+	hbsdmon_thread_msg_t msg;
+	bool res;
 
-	pushover_free_message(&pmsg);
-	free(nodestr);
+	res = hbsdmon_node_ping(thread->ht_ctx, thread->ht_node);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.htm_verb = VERB_VERDICT;
+	msg.htm_uint64 = (res == false);
+	msg.htm_arg = seq;
+	hbsdmon_node_notify(thread->ht_node, &msg);
 }
 
+static void
+hbsdmon_node_success(hbsdmon_thread_t *thread)
+{
+	const char *desc;
+
+	desc = hbsdmon_node_desc(thread->ht_node);
+	if (desc == NULL) {
+		return;
+	}
+
+	hbsdmon_notify(thread->ht_ctx, "NODE ONLINE", desc);
+}
+
+/*
+ * Initialize the node. The main thread sends a single MONITOR INIT
+ * notification once all nodes are up, so none is sent from here.
+ */
 bool
 hbsdmon_node_thread_init(hbsdmon_thread_t *thread)
 {
-	pushover_message_t *pmsg;
-	char *nodestr;
 
 	if (!hbsdmon_node_init(thread->ht_node)) {
 		return (false);
 	}
 
-	pmsg = pushover_init_message(NULL);
-	if (pmsg == NULL) {
+	hbsdmon_node_sched_init(thread->ht_node);
+
+	/* Render the description now rather than on the first alert. */
+	if (hbsdmon_node_desc(thread->ht_node) == NULL) {
 		return (false);
 	}
 
-	nodestr = hbsdmon_node_to_str(thread->ht_node);
-	if (nodestr == NULL) {
-		pushover_free_message(&pmsg);
-		return (false);
+	return (true);
+}
+
+void
+hbsdmon_node_sched_init(hbsdmon_node_t *node)
+{
+
+	node->hn_interval_base = hbsdmon_get_interval(node);
+	node->hn_interval_min = hbsdmon_get_interval_min(node);
+	node->hn_interval_max = hbsdmon_get_interval_max(node);
+
+	if (node->hn_interval_min > node->hn_interval_base) {
+		fprintf(stderr, "[*] %s: interval_min larger than "
+		    "interval. Clamping.\n", node->hn_host);
+		node->hn_interval_min = node->hn_interval_base;
 	}
 
-#ifndef NOSUBMIT
-	/* XXX check for errors */
-	pushover_message_set_dest(pmsg, thread->ht_ctx->hc_dest);
-	pushover_message_set_title(pmsg, "MONITOR INIT");
-	pushover_message_set_msg(pmsg, nodestr);
-	pushover_submit_message(thread->ht_ctx->hc_psh_ctx, pmsg);
-#else
-	fprintf(stderr, "MONITOR INIT:\n%s\n", nodestr);
-#endif
+	if (node->hn_interval_max < node->hn_interval_base) {
+		fprintf(stderr, "[*] %s: interval_max smaller than "
+		    "interval. Clamping.\n", node->hn_host);
+		node->hn_interval_max = node->hn_interval_base;
+	}
 
-	pushover_free_message(&pmsg);
-	free(nodestr);
+	node->hn_interval = node->hn_interval_base;
+	node->hn_nstable = 0;
+	node->hn_failing = false;
+}
 
-	return (true);
+/*
+ * Adapt the probe interval to the outcome of the last probe.
+ *
+ * The first failure drops the node to its minimum interval so the
+ * outage is confirmed quickly. While the node stays down, the
+ * interval backs off toward the configured interval again. A
+ * recovering node starts over at the minimum interval so the
+ * recovery is confirmed just as quickly. Once a node has been up
+ * for HBSDMON_STABLE_PROBES probes in a row, its interval doubles,
+ * up to the maximum interval.
+ */
+void
+hbsdmon_node_adapt_interval(hbsdmon_node_t *node, bool success)
+{
+	long interval;
+
+	if (success == false) {
+		node->hn_nstable = 0;
+		if (node->hn_failing == false) {
+			node->hn_failing = true;
+			node->hn_interval = node->hn_interval_min;
+			return;
+		}
+
+		interval = node->hn_interval * 2;
+		if (interval > node->hn_interval_base) {
+			interval = node->hn_interval_base;
+		}
+		if (interval > node->hn_interval) {
+			node->hn_interval = interval;
+		}
+		return;
+	}
+
+	if (node->hn_failing) {
+		node->hn_failing = false;
+		node->hn_nstable = 0;
+		node->hn_interval = node->hn_interval_min;
+		return;
+	}
+
+	if (++(node->hn_nstable) < HBSDMON_STABLE_PROBES) {
+		return;
+	}
+
+	node->hn_nstable = 0;
+	interval = node->hn_interval * 2;
+	if (interval > node->hn_interval_max) {
+		interval = node->hn_interval_max;
+	}
+	node->hn_interval = interval;
 }
 
 void
@@ -399,12 +695,64 @@ hbsdmon_node_cleanup(hbsdmon_node_t *node)
 	hbsdmon_free_kvstore(&(node->hn_kvstore));
 	free(node->hn_host);
 	node->hn_host = NULL;
+	free(node->hn_desc);
+	node->hn_desc = NULL;
+	node->hn_failmsg = NULL;
+	free(node->hn_name);
+	node->hn_name = NULL;
+	while (node->hn_ndepnames > 0) {
+		free(node->hn_depnames[--(node->hn_ndepnames)]);
+	}
+	free(node->hn_depnames);
+	node->hn_depnames = NULL;
+	free(node->hn_parents);
+	node->hn_parents = NULL;
+	node->hn_nparents = 0;
+	free(node->hn_children);
+	node->hn_children = NULL;
+	node->hn_nchildren = 0;
+	free(node->hn_deps_desc);
+	node->hn_deps_desc = NULL;
+	free(node->hn_zlimits);
+	node->hn_zlimits = NULL;
+	free(node->hn_exec_out);
+	node->hn_exec_out = NULL;
+}
+
+/*
+ * Return the node's description, rendering it only if the
+ * configuration changed since it was last rendered. The returned
+ * string is owned by the node.
+ */
+const char *
+hbsdmon_node_desc(hbsdmon_node_t *node)
+{
+	hbsdmon_ctx_t *ctx;
+	char *desc;
+
+	ctx = node->hn_thread->ht_ctx;
+	if (node->hn_desc != NULL &&
+	    node->hn_desc_gen == ctx->hc_generation) {
+		return (node->hn_desc);
+	}
+
+	desc = hbsdmon_node_to_str(node);
+	if (desc == NULL) {
+		return (node->hn_desc);
+	}
+
+	free(node->hn_desc);
+	node->hn_desc = desc;
+	node->hn_desc_gen = ctx->hc_generation;
+
+	return (desc);
 }
 
 char *
 hbsdmon_node_to_str(hbsdmon_node_t *node)
 {
 	hbsdmon_keyvalue_t *kv;
+	char target[128];
 	char *port, *ret;
 	struct sbuf *sb;
 	int addrfam;
@@ -424,7 +772,7 @@ hbsdmon_node_to_str(hbsdmon_node_t *node)
 	    "Port:		%s\n",
 	    node->hn_thread->ht_ctx->hc_name,
 	    node->hn_host,
-	    hbsdmon_method_to_str(node->hn_method),
+	    hbsdmon_node_method(node),
 	    port)) {
 		free(port);
 		return (NULL);
@@ -459,6 +807,27 @@ hbsdmon_node_to_str(hbsdmon_node_t *node)
 			return (NULL);
 		}
 		break;
+	case METHOD_EXEC:
+		kv = hbsdmon_find_kv(hbsdmon_node_kv(node),
+		    "command", false);
+		if (kv == NULL) {
+			break;
+		}
+		if (sbuf_printf(sb, "Command: %s\n",
+		    hbsdmon_keyvalue_to_str(kv))) {
+			sbuf_delete(sb);
+			return (NULL);
+		}
+		break;
+	case METHOD_PLUGIN:
+		if (hbsdmon_plugin_desc(node, target, sizeof(target)) < 0) {
+			break;
+		}
+		if (sbuf_printf(sb, "Target: %s\n", target)) {
+			sbuf_delete(sb);
+			return (NULL);
+		}
+		break;
 	default:
 		break;
 	}
@@ -494,6 +863,8 @@ hbsdmon_node_port(hbsdmon_node_t *node)
 		return (ret);
 	case METHOD_HTTP:
 		return (strdup("80"));
+	case METHOD_HTTPS:
+		return (strdup("443"));
 	default:
 		return (strdup("N/A"));
 	}
@@ -0,0 +1,296 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hbsdmon.h"
+
+static void *hbsdmon_notify_start(void *);
+static void hbsdmon_notify_spool(hbsdmon_ctx_t *,
+    hbsdmon_notify_queue_t *, size_t);
+
+bool
+hbsdmon_notify_init(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_notifier_t *nq;
+
+	nq = &(ctx->hc_notifier);
+
+	TAILQ_INIT(&(nq->hnq_queue));
+	pthread_mutex_init(&(nq->hnq_mtx), NULL);
+	pthread_cond_init(&(nq->hnq_cv), NULL);
+	nq->hnq_stop = false;
+	nq->hnq_done = false;
+
+	if (pthread_create(&(nq->hnq_tid), NULL, hbsdmon_notify_start,
+	    ctx)) {
+		fprintf(stderr, "[-] Unable to start the notifier thread."
+		    " Notifying synchronously.\n");
+		return (false);
+	}
+
+	nq->hnq_running = true;
+	return (true);
+}
+
+/*
+ * Queue a notification. The title and message are copied. If the
+ * notifier isn't running, the notification is submitted right away.
+ */
+void
+hbsdmon_notify(hbsdmon_ctx_t *ctx, const char *title, const char *msg)
+{
+	hbsdmon_notification_t *ntf;
+	hbsdmon_notifier_t *nq;
+	size_t titlelen, msglen;
+
+	nq = &(ctx->hc_notifier);
+	if (nq->hnq_running == false) {
+		hbsdmon_submit(ctx, title, msg);
+		return;
+	}
+
+	titlelen = strlen(title) + 1;
+	msglen = strlen(msg) + 1;
+
+	/* One allocation holds the entry and both strings. */
+	ntf = malloc(sizeof(*ntf) + titlelen + msglen);
+	if (ntf == NULL) {
+		return;
+	}
+
+	ntf->hnt_title = (char *)(ntf + 1);
+	ntf->hnt_msg = ntf->hnt_title + titlelen;
+	memcpy(ntf->hnt_title, title, titlelen);
+	memcpy(ntf->hnt_msg, msg, msglen);
+
+	pthread_mutex_lock(&(nq->hnq_mtx));
+	TAILQ_INSERT_TAIL(&(nq->hnq_queue), ntf, hnt_entry);
+	nq->hnq_len++;
+	pthread_cond_broadcast(&(nq->hnq_cv));
+	pthread_mutex_unlock(&(nq->hnq_mtx));
+}
+
+/*
+ * Stop the notifier. It gets HBSDMON_FLUSH_TIMEOUT_MS to submit what
+ * is queued. Whatever is left after that is written to the spool, if
+ * one is configured, to be sent on the next start.
+ */
+void
+hbsdmon_notify_fini(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_notification_t *ntf, *tntf;
+	hbsdmon_notify_queue_t rest;
+	hbsdmon_notifier_t *nq;
+	struct timespec ts;
+	size_t nrest;
+
+	nq = &(ctx->hc_notifier);
+	if (nq->hnq_running == false) {
+		return;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += HBSDMON_FLUSH_TIMEOUT_MS / 1000;
+	ts.tv_nsec += (HBSDMON_FLUSH_TIMEOUT_MS % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&(nq->hnq_mtx));
+	nq->hnq_stop = true;
+	pthread_cond_broadcast(&(nq->hnq_cv));
+	while (nq->hnq_done == false) {
+		if (pthread_cond_timedwait(&(nq->hnq_cv), &(nq->hnq_mtx),
+		    &ts) == ETIMEDOUT) {
+			break;
+		}
+	}
+
+	/* Take what's left. The notifier exits after its current one. */
+	TAILQ_INIT(&rest);
+	TAILQ_CONCAT(&rest, &(nq->hnq_queue), hnt_entry);
+	nrest = nq->hnq_len;
+	nq->hnq_len = 0;
+	pthread_mutex_unlock(&(nq->hnq_mtx));
+
+	if (nq->hnq_done) {
+		pthread_join(nq->hnq_tid, NULL);
+	} else {
+		/* Stuck submitting. Don't wait for it. */
+		pthread_detach(nq->hnq_tid);
+	}
+	nq->hnq_running = false;
+
+	if (nrest > 0) {
+		hbsdmon_notify_spool(ctx, &rest, nrest);
+	}
+
+	TAILQ_FOREACH_SAFE(ntf, &rest, hnt_entry, tntf) {
+		free(ntf);
+	}
+}
+
+/*
+ * Append notifications to the spool. Each record is a line holding
+ * the length of the title and of the message, followed by both.
+ */
+static void
+hbsdmon_notify_spool(hbsdmon_ctx_t *ctx, hbsdmon_notify_queue_t *rest,
+    size_t nntf)
+{
+	hbsdmon_notification_t *ntf;
+	size_t titlelen, msglen;
+	FILE *fp;
+
+	if (ctx->hc_spool == NULL) {
+		fprintf(stderr, "[-] Dropping %zu queued notifications."
+		    " No spool configured.\n", nntf);
+		return;
+	}
+
+	fp = fopen(ctx->hc_spool, "a");
+	if (fp == NULL) {
+		fprintf(stderr, "[-] Unable to open spool %s. Dropping %zu"
+		    " queued notifications.\n", ctx->hc_spool, nntf);
+		return;
+	}
+
+	TAILQ_FOREACH(ntf, rest, hnt_entry) {
+		titlelen = strlen(ntf->hnt_title);
+		msglen = strlen(ntf->hnt_msg);
+		fprintf(fp, "%zu %zu\n", titlelen, msglen);
+		fwrite(ntf->hnt_title, 1, titlelen, fp);
+		fwrite(ntf->hnt_msg, 1, msglen, fp);
+	}
+
+	if (fclose(fp)) {
+		fprintf(stderr, "[-] Unable to write spool %s.\n",
+		    ctx->hc_spool);
+		return;
+	}
+
+	fprintf(stderr, "[*] Spooled %zu queued notifications to %s.\n",
+	    nntf, ctx->hc_spool);
+}
+
+/*
+ * Queue the notifications spooled by the last shutdown and remove
+ * the spool.
+ */
+void
+hbsdmon_notify_replay(hbsdmon_ctx_t *ctx)
+{
+	size_t titlelen, msglen, n;
+	char *title, *msg;
+	FILE *fp;
+
+	if (ctx->hc_spool == NULL) {
+		return;
+	}
+
+	fp = fopen(ctx->hc_spool, "r");
+	if (fp == NULL) {
+		return;
+	}
+
+	n = 0;
+	while (fscanf(fp, "%zu %zu", &titlelen, &msglen) == 2) {
+		if (fgetc(fp) != '\n' ||
+		    titlelen > HBSDMON_MSG_MAX || msglen > HBSDMON_MSG_MAX) {
+			break;
+		}
+
+		title = calloc(1, titlelen + 1);
+		msg = calloc(1, msglen + 1);
+		if (title == NULL || msg == NULL ||
+		    fread(title, 1, titlelen, fp) != titlelen ||
+		    fread(msg, 1, msglen, fp) != msglen) {
+			free(title);
+			free(msg);
+			break;
+		}
+
+		hbsdmon_notify(ctx, title, msg);
+		free(title);
+		free(msg);
+		n++;
+	}
+
+	if (!feof(fp)) {
+		fprintf(stderr, "[-] Spool %s is corrupt after %zu"
+		    " notifications.\n", ctx->hc_spool, n);
+	}
+
+	fclose(fp);
+	unlink(ctx->hc_spool);
+}
+
+static void *
+hbsdmon_notify_start(void *argp)
+{
+	hbsdmon_notification_t *ntf;
+	hbsdmon_notifier_t *nq;
+	hbsdmon_ctx_t *ctx;
+
+	assert(argp != NULL);
+
+	ctx = argp;
+	nq = &(ctx->hc_notifier);
+
+	pthread_mutex_lock(&(nq->hnq_mtx));
+	while (true) {
+		ntf = TAILQ_FIRST(&(nq->hnq_queue));
+		if (ntf == NULL) {
+			if (nq->hnq_stop) {
+				nq->hnq_done = true;
+				pthread_cond_broadcast(&(nq->hnq_cv));
+				break;
+			}
+			pthread_cond_wait(&(nq->hnq_cv), &(nq->hnq_mtx));
+			continue;
+		}
+
+		TAILQ_REMOVE(&(nq->hnq_queue), ntf, hnt_entry);
+		nq->hnq_len--;
+		pthread_mutex_unlock(&(nq->hnq_mtx));
+
+		hbsdmon_submit(ctx, ntf->hnt_title, ntf->hnt_msg);
+		free(ntf);
+
+		pthread_mutex_lock(&(nq->hnq_mtx));
+	}
+	pthread_mutex_unlock(&(nq->hnq_mtx));
+
+	return (NULL);
+}
@@ -0,0 +1,412 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/param.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ucl.h>
+
+#include "hbsdmon.h"
+#include "hbsdmon_plugin.h"
+
+_Static_assert(HBSDMON_PLUGIN_PHASES == PHASE_MAX,
+    "plugin phases out of sync");
+
+static void hbsdmon_plugin_batch(hbsdmon_plugin_mod_t *,
+    hbsdmon_node_t **, size_t);
+
+/*
+ * Load the plugin at path and register its method. Plugins are
+ * loaded once, while parsing the configuration, and stay loaded
+ * until shutdown.
+ */
+bool
+hbsdmon_plugin_load(hbsdmon_ctx_t *ctx, const char *path)
+{
+	const hbsdmon_plugin_t *plugin;
+	hbsdmon_plugin_mod_t *mod;
+	pthread_condattr_t attr;
+	hbsdmon_method_t method;
+	void *dl;
+
+	dl = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (dl == NULL) {
+		fprintf(stderr, "[-] Unable to load plugin %s: %s\n", path,
+		    dlerror());
+		return (false);
+	}
+
+	plugin = dlsym(dl, HBSDMON_PLUGIN_SYMBOL);
+	if (plugin == NULL) {
+		fprintf(stderr, "[-] Plugin %s does not export %s.\n", path,
+		    HBSDMON_PLUGIN_SYMBOL);
+		goto err;
+	}
+
+	if (plugin->hp_abi != HBSDMON_PLUGIN_ABI) {
+		fprintf(stderr, "[-] Plugin %s was built for ABI %u, not"
+		    " %u.\n", path, plugin->hp_abi, HBSDMON_PLUGIN_ABI);
+		goto err;
+	}
+
+	if (plugin->hp_method == NULL || plugin->hp_probe == NULL) {
+		fprintf(stderr, "[-] Plugin %s has no method or no probe"
+		    " function.\n", path);
+		goto err;
+	}
+
+	for (method = 0; method < METHOD_PLUGIN; method++) {
+		if (hbsdmon_method_to_str(method) != NULL &&
+		    !strcasecmp(hbsdmon_method_to_str(method),
+		    plugin->hp_method)) {
+			break;
+		}
+	}
+	if (method < METHOD_PLUGIN ||
+	    hbsdmon_plugin_find(ctx, plugin->hp_method) != NULL) {
+		fprintf(stderr, "[-] Plugin %s: method %s is already"
+		    " defined.\n", path, plugin->hp_method);
+		goto err;
+	}
+
+	mod = calloc(1, sizeof(*mod));
+	if (mod == NULL) {
+		goto err;
+	}
+
+	mod->hpm_path = strdup(path);
+	if (mod->hpm_path == NULL) {
+		free(mod);
+		goto err;
+	}
+
+	if (plugin->hp_init != NULL && !plugin->hp_init()) {
+		fprintf(stderr, "[-] Plugin %s failed to initialize.\n",
+		    path);
+		free(mod->hpm_path);
+		free(mod);
+		goto err;
+	}
+
+	mod->hpm_dl = dl;
+	mod->hpm_plugin = plugin;
+	mod->hpm_fd = -1;
+	if (plugin->hp_fd != NULL && plugin->hp_ready != NULL) {
+		mod->hpm_fd = plugin->hp_fd();
+		if (mod->hpm_fd < 0) {
+			mod->hpm_fd = -1;
+		}
+	}
+
+	/* Batches are gathered against the monotonic clock. */
+	pthread_mutex_init(&(mod->hpm_mtx), NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(mod->hpm_cv), &attr);
+	pthread_condattr_destroy(&attr);
+
+	SLIST_INSERT_HEAD(&(ctx->hc_plugins), mod, hpm_entry);
+	ctx->hc_nplugins++;
+
+	return (true);
+
+err:
+	dlclose(dl);
+	return (false);
+}
+
+hbsdmon_plugin_mod_t *
+hbsdmon_plugin_find(hbsdmon_ctx_t *ctx, const char *method)
+{
+	hbsdmon_plugin_mod_t *mod;
+
+	SLIST_FOREACH(mod, &(ctx->hc_plugins), hpm_entry) {
+		if (!strcasecmp(mod->hpm_plugin->hp_method, method)) {
+			return (mod);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Make node one of the plugin's. The plugin gets to check the node's
+ * configuration object and keep whatever it needs from it.
+ */
+bool
+hbsdmon_plugin_add_node(hbsdmon_plugin_mod_t *mod, hbsdmon_node_t *node,
+    const ucl_object_t *obj)
+{
+	hbsdmon_node_t **pending;
+
+	if (mod->hpm_plugin->hp_parse != NULL &&
+	    !mod->hpm_plugin->hp_parse(node->hn_host, obj,
+	    &(node->hn_plugin_arg))) {
+		fprintf(stderr, "[-] Invalid %s options for host %s\n",
+		    mod->hpm_plugin->hp_method, node->hn_host);
+		return (false);
+	}
+
+	/* Room for every node of the plugin in one batch. */
+	pending = reallocarray(mod->hpm_pending, mod->hpm_nnodes + 1,
+	    sizeof(*pending));
+	if (pending == NULL) {
+		return (false);
+	}
+	mod->hpm_pending = pending;
+	mod->hpm_nnodes++;
+
+	node->hn_method = METHOD_PLUGIN;
+	node->hn_plugin = mod;
+
+	return (true);
+}
+
+void
+hbsdmon_plugin_fini(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_plugin_mod_t *mod, *tmod;
+	hbsdmon_node_t *node;
+
+	/*
+	 * A node thread that was cancelled on shutdown may be stuck
+	 * in a batch. Leave everything to exit() then.
+	 */
+	SLIST_FOREACH(mod, &(ctx->hc_plugins), hpm_entry) {
+		if (pthread_mutex_trylock(&(mod->hpm_mtx)) != 0) {
+			return;
+		}
+		pthread_mutex_unlock(&(mod->hpm_mtx));
+	}
+
+	SLIST_FOREACH(node, &(ctx->hc_nodes), hn_entry) {
+		if (node->hn_plugin == NULL) {
+			continue;
+		}
+		if (node->hn_plugin->hpm_plugin->hp_free != NULL) {
+			node->hn_plugin->hpm_plugin->hp_free(
+			    node->hn_plugin_arg);
+		}
+		node->hn_plugin_arg = NULL;
+		node->hn_plugin = NULL;
+	}
+
+	SLIST_FOREACH_SAFE(mod, &(ctx->hc_plugins), hpm_entry, tmod) {
+		if (mod->hpm_plugin->hp_fini != NULL) {
+			mod->hpm_plugin->hp_fini();
+		}
+		dlclose(mod->hpm_dl);
+		pthread_cond_destroy(&(mod->hpm_cv));
+		pthread_mutex_destroy(&(mod->hpm_mtx));
+		free(mod->hpm_pending);
+		free(mod->hpm_path);
+		free(mod);
+	}
+	SLIST_INIT(&(ctx->hc_plugins));
+	ctx->hc_nplugins = 0;
+}
+
+/*
+ * Probe the node through its plugin. The first node of a plugin to
+ * come due waits HBSDMON_PLUGIN_GATHER_MS for others to join it,
+ * then probes them all in one call. The others sleep until their
+ * results are in.
+ */
+bool
+hbsdmon_plugin_probe(hbsdmon_node_t *node)
+{
+	hbsdmon_plugin_mod_t *mod;
+	struct timespec deadline;
+	hbsdmon_node_t **batch;
+	size_t n;
+	bool res;
+
+	mod = node->hn_plugin;
+	assert(mod != NULL);
+
+	pthread_mutex_lock(&(mod->hpm_mtx));
+	node->hn_plugin_done = false;
+	mod->hpm_pending[mod->hpm_npending++] = node;
+
+	if (mod->hpm_npending == 1) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += HBSDMON_PLUGIN_GATHER_MS * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		while (mod->hpm_npending < mod->hpm_nnodes &&
+		    pthread_cond_timedwait(&(mod->hpm_cv), &(mod->hpm_mtx),
+		    &deadline) != ETIMEDOUT) {
+			continue;
+		}
+
+		/* Nodes due from now on start the next batch. */
+		n = mod->hpm_npending;
+		batch = calloc(n, sizeof(*batch));
+		if (batch != NULL) {
+			memcpy(batch, mod->hpm_pending, n * sizeof(*batch));
+			mod->hpm_npending = 0;
+			pthread_mutex_unlock(&(mod->hpm_mtx));
+			hbsdmon_plugin_batch(mod, batch, n);
+			pthread_mutex_lock(&(mod->hpm_mtx));
+			free(batch);
+		} else {
+			fprintf(stderr, "[-] Unable to probe a batch of %zu"
+			    " %s nodes: out of memory.\n", n,
+			    mod->hpm_plugin->hp_method);
+			while (mod->hpm_npending > 0) {
+				batch = &(mod->hpm_pending[
+				    --(mod->hpm_npending)]);
+				(*batch)->hn_plugin_ok = true;
+				(*batch)->hn_plugin_done = true;
+			}
+			pthread_cond_broadcast(&(mod->hpm_cv));
+		}
+	} else {
+		pthread_cond_broadcast(&(mod->hpm_cv));
+	}
+
+	while (!node->hn_plugin_done) {
+		pthread_cond_wait(&(mod->hpm_cv), &(mod->hpm_mtx));
+	}
+	res = node->hn_plugin_ok;
+	pthread_mutex_unlock(&(mod->hpm_mtx));
+
+	return (res);
+}
+
+/*
+ * Hand a batch of nodes to the plugin and deliver the results to the
+ * nodes' threads.
+ */
+static void
+hbsdmon_plugin_batch(hbsdmon_plugin_mod_t *mod, hbsdmon_node_t **batch,
+    size_t n)
+{
+	hbsdmon_plugin_target_t *targets;
+	hbsdmon_phase_t phase;
+	hbsdmon_node_t *node;
+	hbsdmon_ctx_t *ctx;
+	size_t i;
+
+	targets = calloc(n, sizeof(*targets));
+	if (targets != NULL) {
+		for (i = 0; i < n; i++) {
+			targets[i].hpt_host = batch[i]->hn_host;
+			targets[i].hpt_arg = batch[i]->hn_plugin_arg;
+			targets[i].hpt_ok = true;
+			targets[i].hpt_failed = PHASE_MAX;
+		}
+		mod->hpm_plugin->hp_probe(targets, n,
+		    HBSDMON_PLUGIN_TIMEOUT_MS);
+	} else {
+		fprintf(stderr, "[-] Unable to probe a batch of %zu %s"
+		    " nodes: out of memory.\n", n,
+		    mod->hpm_plugin->hp_method);
+	}
+
+	pthread_mutex_lock(&(mod->hpm_mtx));
+	for (i = 0; i < n; i++) {
+		node = batch[i];
+		node->hn_plugin_ok = true;
+		if (targets != NULL) {
+			node->hn_plugin_ok = targets[i].hpt_ok;
+			for (phase = 0; phase < PHASE_MAX; phase++) {
+				if (targets[i].hpt_valid & (1 << phase)) {
+					hbsdmon_probe_time(&(node->hn_probe),
+					    phase, targets[i].hpt_phases[phase]);
+				}
+			}
+			if (!targets[i].hpt_ok) {
+				node->hn_probe.hp_failed =
+				    (targets[i].hpt_failed >= 0 &&
+				    targets[i].hpt_failed < PHASE_MAX) ?
+				    targets[i].hpt_failed : PHASE_TOTAL;
+			}
+		}
+		node->hn_plugin_done = true;
+	}
+	pthread_cond_broadcast(&(mod->hpm_cv));
+	pthread_mutex_unlock(&(mod->hpm_mtx));
+
+	free(targets);
+
+	ctx = batch[0]->hn_thread->ht_ctx;
+	hbsdmon_lock_ctx(ctx);
+	ctx->hc_stats.hs_nplugin_batches++;
+	ctx->hc_stats.hs_nplugin_probes += n;
+	hbsdmon_unlock_ctx(ctx);
+}
+
+/*
+ * Describe the node's target, as the plugin sees it, into buf.
+ * Returns -1 when the plugin has nothing to say.
+ */
+int
+hbsdmon_plugin_desc(hbsdmon_node_t *node, char *buf, size_t len)
+{
+
+	if (node->hn_plugin == NULL ||
+	    node->hn_plugin->hpm_plugin->hp_desc == NULL) {
+		return (-1);
+	}
+
+	return (node->hn_plugin->hpm_plugin->hp_desc(node->hn_plugin_arg,
+	    buf, len));
+}
+
+/*
+ * The plugin's descriptor is readable. Probe the nodes it says
+ * should be probed now.
+ */
+void
+hbsdmon_plugin_recv(hbsdmon_ctx_t *ctx, hbsdmon_plugin_mod_t *mod)
+{
+	hbsdmon_node_t *node, *tnode;
+	void *args[64];
+	size_t i, n;
+
+	n = mod->hpm_plugin->hp_ready(args, nitems(args));
+	if (n > nitems(args)) {
+		n = nitems(args);
+	}
+
+	for (i = 0; i < n; i++) {
+		SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+			if (node->hn_plugin != mod ||
+			    (args[i] != NULL &&
+			    node->hn_plugin_arg != args[i])) {
+				continue;
+			}
+			hbsdmon_node_tell(node, VERB_PROBE, 0, 0);
+		}
+	}
+}
@@ -0,0 +1,189 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/sbuf.h>
+
+#include "hbsdmon.h"
+
+char *
+hbsdmon_stats_to_str(hbsdmon_ctx_t *ctx)
+{
+	struct tm localt;
+	char timebuf[32];
+	time_t heartbeat;
+	struct sbuf *sb;
+	char *ret;
+
+	sb = sbuf_new_auto();
+	if (sb == NULL) {
+		return (NULL);
+	}
+
+	memset(&localt, 0, sizeof(localt));
+	memset(timebuf, 0, sizeof(timebuf));
+	heartbeat = hbsdmon_get_last_heartbeat(ctx);
+	localtime_r(&heartbeat, &localt);
+	asctime_r(&localt, timebuf);
+
+	sbuf_printf(sb, "Monitor name: %s\n", ctx->hc_name);
+	sbuf_printf(sb, "Last heartbeat: %s\n", timebuf);
+
+	sbuf_printf(sb, "Nodes: %zu\n", ctx->hc_nnodes);
+	if (ctx->hc_cluster != NULL) {
+		sbuf_printf(sb,
+		    "Cluster members: %zu\n"
+		    "Owned nodes: %zu\n"
+		    "Confirmations: %zu\n"
+		    "Confirmed failures: %zu\n"
+		    "Refuted failures: %zu\n",
+		    ctx->hc_cluster->hcl_nalive,
+		    ctx->hc_cluster->hcl_nowned,
+		    ctx->hc_stats.hs_nconfirms,
+		    ctx->hc_stats.hs_nconfirmed,
+		    ctx->hc_stats.hs_nrefuted);
+	}
+	if (ctx->hc_zfs != NULL) {
+		sbuf_printf(sb,
+		    "ZFS pools: %zu\n"
+		    "ZFS refreshes: %zu\n"
+		    "ZFS events: %zu\n",
+		    ctx->hc_zfs->hz_npools,
+		    ctx->hc_stats.hs_nzfsrefreshes,
+		    ctx->hc_stats.hs_nzfsevents);
+	}
+	if (ctx->hc_exec != NULL) {
+		sbuf_printf(sb,
+		    "Commands: %zu (%zu spawned directly, %zu timed out)\n",
+		    ctx->hc_stats.hs_nexecs,
+		    ctx->hc_stats.hs_nexec_spawns,
+		    ctx->hc_stats.hs_nexec_timeouts);
+	}
+	if (ctx->hc_nplugins > 0) {
+		sbuf_printf(sb,
+		    "Plugins: %zu\n"
+		    "Plugin batches: %zu (%zu probes)\n",
+		    ctx->hc_nplugins,
+		    ctx->hc_stats.hs_nplugin_batches,
+		    ctx->hc_stats.hs_nplugin_probes);
+	}
+	if (ctx->hc_ndeps > 0) {
+		sbuf_printf(sb, "Unreachable nodes: %zu\n",
+		    ctx->hc_nunreachable);
+	}
+
+	sbuf_printf(sb,
+	    "Heartbeats: %zu\n"
+	    "Probes: %zu\n"
+	    "Errors: %zu\n"
+	    "Successes: %zu\n"
+	    "Poll failures: %zu\n",
+	    ctx->hc_stats.hs_nheartbeats,
+	    ctx->hc_stats.hs_nprobes,
+	    ctx->hc_stats.hs_nerrors,
+	    ctx->hc_stats.hs_nsuccess,
+	    ctx->hc_stats.hs_npollfails);
+
+	sbuf_printf(sb,
+	    "Late probes: %zu\n"
+	    "Late wakeups: %zu\n",
+	    ctx->hc_stats.hs_nlateprobes,
+	    ctx->hc_stats.hs_nlatewakes);
+
+	hbsdmon_hist_to_sbuf(sb, "Probe drift", &(ctx->hc_stats.hs_drift));
+	hbsdmon_hist_to_sbuf(sb, "Wake lag", &(ctx->hc_stats.hs_wakelag));
+	hbsdmon_zfs_stats_to_sbuf(ctx, sb);
+
+	if (sbuf_finish(sb)) {
+		sbuf_delete(sb);
+		return (NULL);
+	}
+
+	ret = strdup(sbuf_data(sb));
+	sbuf_delete(sb);
+
+	return (ret);
+}
+
+void
+hbsdmon_hist_add(hbsdmon_hist_t *hist, uint64_t ms)
+{
+	size_t bucket;
+	uint64_t v;
+
+	bucket = 0;
+	for (v = ms; v > 0 && bucket < HBSDMON_HIST_BUCKETS - 1; v >>= 1) {
+		bucket++;
+	}
+
+	hist->hh_buckets[bucket]++;
+	hist->hh_count++;
+	hist->hh_sum += ms;
+	if (ms > hist->hh_max) {
+		hist->hh_max = ms;
+	}
+}
+
+/*
+ * Render a histogram as a summary line followed by one line with the
+ * non-empty buckets, each labeled with its upper bound in ms.
+ */
+void
+hbsdmon_hist_to_sbuf(struct sbuf *sb, const char *name,
+    hbsdmon_hist_t *hist)
+{
+	size_t i;
+
+	sbuf_printf(sb, "%s: n=%ju mean=%jums max=%jums\n", name,
+	    (uintmax_t)hist->hh_count,
+	    (uintmax_t)(hist->hh_count ? hist->hh_sum / hist->hh_count : 0),
+	    (uintmax_t)hist->hh_max);
+
+	if (hist->hh_count == 0) {
+		return;
+	}
+
+	sbuf_cat(sb, "   ");
+	for (i = 0; i < HBSDMON_HIST_BUCKETS; i++) {
+		if (hist->hh_buckets[i] == 0) {
+			continue;
+		}
+		if (i == HBSDMON_HIST_BUCKETS - 1) {
+			sbuf_printf(sb, " >=%ju:%ju",
+			    (uintmax_t)1 << (i - 1),
+			    (uintmax_t)hist->hh_buckets[i]);
+		} else {
+			sbuf_printf(sb, " <%ju:%ju", (uintmax_t)1 << i,
+			    (uintmax_t)hist->hh_buckets[i]);
+		}
+	}
+	sbuf_cat(sb, "\n");
+}
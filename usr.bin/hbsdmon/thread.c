@@ -25,6 +25,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,31 +34,198 @@
 
 #include "hbsdmon.h"
 
+#include <sys/types.h>
+#include <sys/sbuf.h>
+
 static void *hbsdmon_thread_start(void *);
 static bool hbsdmon_create_node_thread(hbsdmon_ctx_t *,
     hbsdmon_node_t *);
 static void hbsdmon_thread_notify(hbsdmon_thread_t *,
     hbsdmon_thread_msg_t *);
 static void hbsdmon_thread_exit(hbsdmon_thread_t *);
-
+static bool hbsdmon_thread_handshake(hbsdmon_ctx_t *);
+static void hbsdmon_thread_init_summary(hbsdmon_ctx_t *);
+
+/*
+ * Start the node threads. All threads are created first and then
+ * initialized concurrently, so startup doesn't grow with the number
+ * of nodes times the time one node takes to initialize. A single
+ * MONITOR INIT notification summarizes the result.
+ */
 bool
 hbsdmon_thread_init(hbsdmon_ctx_t *ctx) {
 	hbsdmon_node_t *node, *tnode;
+	bool res;
+
+	/*
+	 * Every node uses two sockets. Raise ZeroMQ's socket limit,
+	 * which defaults to 1023, before the first one is created.
+	 */
+	if (zmq_ctx_set(ctx->hc_zmq, ZMQ_MAX_SOCKETS,
+	    (int)(ctx->hc_nnodes * 2 + 16))) {
+		fprintf(stderr, "[-] Unable to raise the ZeroMQ socket"
+		    " limit. Large configs will fail to start.\n");
+	}
 
+	res = true;
 	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
 		if (hbsdmon_create_node_thread(ctx, node) == false) {
-			return (false);
+			res = false;
+			break;
 		}
 	}
 
-	return (true);
+	if (hbsdmon_thread_handshake(ctx) == false) {
+		res = false;
+	}
+
+	hbsdmon_thread_init_summary(ctx);
+
+	return (res);
+}
+
+/*
+ * Each new thread tells us it's ready, we answer with VERB_INIT and
+ * it acknowledges with VERB_INIT once its node is initialized, or
+ * with VERB_TERM if initialization failed. Serve all threads from a
+ * single poll set so the handshakes overlap. Threads that are done
+ * are swapped out of the set.
+ */
+static bool
+hbsdmon_thread_handshake(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_thread_t *thread, *tthread, **threads;
+	zmq_pollitem_t *pollitems;
+	hbsdmon_thread_msg_t msg;
+	size_t i, npending;
+	bool done, res;
+	int nrecv;
+
+	pollitems = calloc(ctx->hc_nthreads, sizeof(*pollitems));
+	threads = calloc(ctx->hc_nthreads, sizeof(*threads));
+	if (pollitems == NULL || threads == NULL) {
+		free(pollitems);
+		free(threads);
+		return (false);
+	}
+
+	npending = 0;
+	SLIST_FOREACH_SAFE(thread, &(ctx->hc_threads), ht_entry,
+	    tthread) {
+		pollitems[npending].socket = thread->ht_zmqsock;
+		pollitems[npending].events = ZMQ_POLLIN;
+		threads[npending] = thread;
+		npending++;
+	}
+
+	res = true;
+	while (npending > 0) {
+		if (zmq_poll(pollitems, (int)npending, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "[-] zmq_poll failed during"
+			    " startup.\n");
+			res = false;
+			break;
+		}
+
+		i = 0;
+		while (i < npending) {
+			if ((pollitems[i].revents & ZMQ_POLLIN) == 0) {
+				i++;
+				continue;
+			}
+
+			thread = threads[i];
+			done = false;
+
+			memset(&msg, 0, sizeof(msg));
+			nrecv = zmq_recv(thread->ht_zmqsock, &msg,
+			    sizeof(msg), 0);
+			if (nrecv == 0) {
+				/* Ready. Send the init message. */
+				memset(&msg, 0, sizeof(msg));
+				msg.htm_verb = VERB_INIT;
+				zmq_send(thread->ht_zmqsock, &msg,
+				    sizeof(msg), 0);
+			} else if (nrecv == sizeof(msg) &&
+			    msg.htm_verb == VERB_INIT) {
+				thread->ht_flags |= HBSDMON_THREAD_STARTED;
+				done = true;
+			} else {
+				pthread_join(thread->ht_tid, NULL);
+				thread->ht_flags |= HBSDMON_THREAD_FAILED;
+				done = true;
+			}
+
+			if (done == false) {
+				pollitems[i].revents = 0;
+				i++;
+				continue;
+			}
+
+			npending--;
+			pollitems[i] = pollitems[npending];
+			threads[i] = threads[npending];
+		}
+	}
+
+	free(pollitems);
+	free(threads);
+
+	return (res);
+}
+
+static void
+hbsdmon_thread_init_summary(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_thread_t *thread, *tthread;
+	char body[HBSDMON_MSG_MAX];
+	struct sbuf sb;
+	size_t nstarted;
+
+	nstarted = 0;
+	SLIST_FOREACH_SAFE(thread, &(ctx->hc_threads), ht_entry,
+	    tthread) {
+		if (thread->ht_flags & HBSDMON_THREAD_STARTED) {
+			nstarted++;
+		}
+	}
+
+	sbuf_new(&sb, body, sizeof(body), SBUF_FIXEDLEN);
+	sbuf_printf(&sb,
+	    "Monitor name:	%s\n"
+	    "Nodes:		%zu\n"
+	    "Started:	%zu\n"
+	    "Failed:		%zu\n",
+	    ctx->hc_name, ctx->hc_nnodes, nstarted,
+	    ctx->hc_nnodes - nstarted);
+
+	if (nstarted < ctx->hc_nnodes) {
+		sbuf_cat(&sb, "\nFailed to start:\n");
+		SLIST_FOREACH_SAFE(thread, &(ctx->hc_threads), ht_entry,
+		    tthread) {
+			if (thread->ht_flags & HBSDMON_THREAD_STARTED) {
+				continue;
+			}
+			sbuf_printf(&sb, "%s (%s)\n",
+			    thread->ht_node->hn_host,
+			    hbsdmon_node_method(thread->ht_node));
+		}
+	}
+
+	/* A long list of failed nodes is truncated. */
+	sbuf_finish(&sb);
+
+	hbsdmon_notify(ctx, "MONITOR INIT", sbuf_data(&sb));
+	sbuf_delete(&sb);
 }
 
 static bool
 hbsdmon_create_node_thread(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node)
 {
 	hbsdmon_thread_t *thread;
-	hbsdmon_thread_msg_t msg;
 	char sockname[512];
 
 	thread = calloc(1, sizeof(*thread));
@@ -104,14 +272,7 @@ hbsdmon_create_node_thread(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node)
 		return (false);
 	}
 
-	/* Wait for the new thread to tell us it's ready */
-	zmq_recv(thread->ht_zmqsock, NULL, 0, 0);
-
-	/* Send init message */
-	memset(&msg, 0, sizeof(msg));
-	msg.htm_verb = VERB_INIT;
-	zmq_send(thread->ht_zmqsock, &msg, sizeof(msg), 0);
-
+	/* The ready/init handshake is done for all threads at once. */
 	SLIST_INSERT_HEAD(&(ctx->hc_threads), thread, ht_entry);
 
 	return (true);
@@ -157,6 +318,8 @@ hbsdmon_thread_start(void *argp)
 		if (!hbsdmon_node_thread_init(thread)) {
 			goto end;
 		}
+		/* Acknowledge */
+		hbsdmon_thread_notify(thread, &msg);
 		break;
 	default:
 		goto end;
@@ -169,6 +332,41 @@ end:
 	return (NULL);
 }
 
+/*
+ * Send a message from the main thread to a worker.
+ */
+bool
+hbsdmon_thread_send(hbsdmon_thread_t *thread, hbsdmon_thread_msg_t *msg)
+{
+
+	return (zmq_send(thread->ht_zmqsock, msg, sizeof(*msg), 0) ==
+	    sizeof(*msg));
+}
+
+/*
+ * Pass a verb on to a node's thread, if it's running.
+ */
+void
+hbsdmon_node_tell(hbsdmon_node_t *node, hbsdmon_thread_msg_verb_t verb,
+    uint64_t val, uint64_t arg)
+{
+	hbsdmon_thread_msg_t tmsg;
+	hbsdmon_thread_t *thread;
+
+	thread = node->hn_thread;
+	if (thread == NULL ||
+	    (thread->ht_flags & HBSDMON_THREAD_STARTED) == 0 ||
+	    (thread->ht_flags & HBSDMON_THREAD_FAILED)) {
+		return;
+	}
+
+	memset(&tmsg, 0, sizeof(tmsg));
+	tmsg.htm_verb = verb;
+	tmsg.htm_uint64 = val;
+	tmsg.htm_arg = arg;
+	hbsdmon_thread_send(thread, &tmsg);
+}
+
 static void
 hbsdmon_thread_notify(hbsdmon_thread_t *thread,
     hbsdmon_thread_msg_t *msg)
@@ -32,6 +32,7 @@
 #include <ucl.h>
 
 #include "hbsdmon.h"
+#include "hbsdmon_plugin.h"
 
 
 hbsdmon_method_t
@@ -49,6 +50,8 @@ hbsdmon_str_to_method(const char *method)
 		return (METHOD_UDP);
 	if (!strcasecmp(method, "ZFS"))
 		return (METHOD_ZFS);
+	if (!strcasecmp(method, "EXEC"))
+		return (METHOD_EXEC);
 
 	/* Default to ICMP */
 	return METHOD_ICMP;
@@ -71,32 +74,124 @@ hbsdmon_method_to_str(hbsdmon_method_t method)
 		return ("UDP");
 	case METHOD_ZFS:
 		return ("ZFS");
+	case METHOD_EXEC:
+		return ("EXEC");
+	case METHOD_PLUGIN:
+		return ("PLUGIN");
 	default:
 		return (NULL);
 	}
 }
 
-long
-hbsdmon_get_interval(hbsdmon_node_t *node)
+/* The name of the node's method, as given in the configuration. */
+const char *
+hbsdmon_node_method(hbsdmon_node_t *node)
+{
+
+	if (node->hn_method == METHOD_PLUGIN && node->hn_plugin != NULL) {
+		return (node->hn_plugin->hpm_plugin->hp_method);
+	}
+
+	return (hbsdmon_method_to_str(node->hn_method));
+}
+
+static long
+hbsdmon_get_interval_kv(hbsdmon_node_t *node, const char *key)
 {
 	hbsdmon_keyvalue_t *kv;
 
-	kv = hbsdmon_find_kv_in_node(node, "interval", false);
+	kv = hbsdmon_find_kv_in_node(node, key, false);
 	if (kv != NULL) {
 		return ((long)hbsdmon_keyvalue_to_uint64(kv));
 	}
 
 	/* XXX So much indirection! */
 	kv = hbsdmon_find_kv(node->hn_thread->ht_ctx->hc_kvstore,
-	    "interval", false);
+	    key, false);
 	if (kv != NULL) {
 		return ((long)hbsdmon_keyvalue_to_uint64(kv));
 	}
 
+	return (0);
+}
+
+const char *
+hbsdmon_phase_to_str(hbsdmon_phase_t phase)
+{
+
+	switch (phase) {
+	case PHASE_DNS:
+		return ("DNS");
+	case PHASE_CONNECT:
+		return ("Connect");
+	case PHASE_TLS:
+		return ("TLS");
+	case PHASE_FIRSTBYTE:
+		return ("First byte");
+	case PHASE_TOTAL:
+		return ("Total");
+	default:
+		return (NULL);
+	}
+}
+
+const char *
+hbsdmon_zscan_to_str(hbsdmon_zscan_t scan)
+{
+
+	switch (scan) {
+	case ZSCAN_SCRUB:
+		return ("Scrub");
+	case ZSCAN_RESILVER:
+		return ("Resilver");
+	default:
+		return ("None");
+	}
+}
+
+long
+hbsdmon_get_interval(hbsdmon_node_t *node)
+{
+	long interval;
+
+	interval = hbsdmon_get_interval_kv(node, "interval");
+	if (interval > 0) {
+		return (interval);
+	}
+
 	/* 5 seconds seems sane */
 	return (5);
 }
 
+long
+hbsdmon_get_interval_min(hbsdmon_node_t *node)
+{
+	long interval;
+
+	interval = hbsdmon_get_interval_kv(node, "interval_min");
+	if (interval > 0) {
+		return (interval);
+	}
+
+	/* Probe failing nodes four times as often by default. */
+	interval = hbsdmon_get_interval(node) / 4;
+	return (interval > 0 ? interval : 1);
+}
+
+long
+hbsdmon_get_interval_max(hbsdmon_node_t *node)
+{
+	long interval;
+
+	interval = hbsdmon_get_interval_kv(node, "interval_max");
+	if (interval > 0) {
+		return (interval);
+	}
+
+	/* Stable nodes don't relax unless told to. */
+	return (hbsdmon_get_interval(node));
+}
+
 time_t
 hbsdmon_get_last_heartbeat(hbsdmon_ctx_t *ctx)
 {
@@ -169,3 +264,65 @@ hbsdmon_reset_stats(hbsdmon_ctx_t *ctx)
 
 	memset(&(ctx->hc_stats), 0, sizeof(ctx->hc_stats));
 }
+
+/*
+ * Milliseconds on the monotonic clock. Used for scheduling, so it
+ * must not jump when the wall clock is adjusted.
+ */
+uint64_t
+hbsdmon_now_ms(void)
+{
+
+	return (hbsdmon_now_us() / 1000);
+}
+
+uint64_t
+hbsdmon_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/*
+ * Record the duration of one probe phase, in microseconds.
+ */
+void
+hbsdmon_probe_time(hbsdmon_probe_t *probe, hbsdmon_phase_t phase,
+    uint64_t us)
+{
+
+	assert(phase < PHASE_MAX);
+
+	probe->hp_phases[phase] = us;
+	probe->hp_valid |= 1 << phase;
+}
+
+/*
+ * Submit a notification to Pushover. When running dry (-n), print it
+ * to stderr instead.
+ */
+void
+hbsdmon_submit(hbsdmon_ctx_t *ctx, const char *title, const char *msg)
+{
+	pushover_message_t *pmsg;
+
+	if (ctx->hc_dryrun) {
+		fprintf(stderr, "%s:\n%s\n", title, msg);
+		return;
+	}
+
+	pmsg = pushover_init_message(NULL);
+	if (pmsg == NULL) {
+		return;
+	}
+
+	/* XXX check for errors */
+	pushover_message_set_dest(pmsg, ctx->hc_dest);
+	pushover_message_set_title(pmsg, title);
+	pushover_message_set_msg(pmsg, msg);
+	pushover_submit_message(ctx->hc_psh_ctx, pmsg);
+	pushover_free_message(&pmsg);
+}
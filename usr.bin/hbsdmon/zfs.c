@@ -37,93 +37,613 @@
 
 #include <stdint.h>
 #include <sys/types.h>
-
-#include <libzfs.h>
-#include <libzfs_core.h>
+#include <sys/sbuf.h>
 
 #include <ucl.h>
 
 #include "hbsdmon.h"
 
+static void hbsdmon_zfs_refresh(hbsdmon_zfs_t *);
+static bool hbsdmon_zfs_events_start(hbsdmon_ctx_t *);
+static void *hbsdmon_zfs_events_run(void *);
+static bool hbsdmon_zfs_event_relevant(const hbsdmon_zevent_t *);
+static void hbsdmon_zfs_metrics_to_sbuf(hbsdmon_zpool_t *, struct sbuf *);
+static size_t hbsdmon_zfs_check_limits(hbsdmon_zfs_limits_t *,
+    hbsdmon_zpool_t *, struct sbuf *);
+
+/* Backends, in order of preference. The first is the default. */
+static const hbsdmon_zfs_backend_t *hbsdmon_zfs_backends[] = {
+#ifndef WITHOUT_LIBZFS
+	&hbsdmon_zfs_libzfs,
+#endif
+	&hbsdmon_zfs_mock,
+	NULL,
+};
+
+/*
+ * Create the ZFS layer with the named backend, or the default one if
+ * name is NULL.
+ */
+hbsdmon_zfs_t *
+hbsdmon_zfs_new(const char *name)
+{
+	const hbsdmon_zfs_backend_t *backend;
+	hbsdmon_zfs_t *zfs;
+	size_t i;
+
+	backend = NULL;
+	for (i = 0; hbsdmon_zfs_backends[i] != NULL; i++) {
+		if (name == NULL ||
+		    strcasecmp(name, hbsdmon_zfs_backends[i]->hzb_name) == 0) {
+			backend = hbsdmon_zfs_backends[i];
+			break;
+		}
+	}
+
+	if (backend == NULL) {
+		fprintf(stderr, "[-] Unknown ZFS backend %s.\n", name);
+		return (NULL);
+	}
+
+	zfs = calloc(1, sizeof(*zfs));
+	if (zfs == NULL) {
+		return (NULL);
+	}
+
+	zfs->hz_backend = backend;
+	zfs->hz_reconcile_ms = HBSDMON_ZFS_RECONCILE * 1000;
+	zfs->hz_wantevents = true;
+	zfs->hz_evfd = -1;
+	pthread_mutex_init(&(zfs->hz_mtx), NULL);
+	SLIST_INIT(&(zfs->hz_pools));
+
+	return (zfs);
+}
+
+/*
+ * Have a node watch a pool. Nodes watching the same pool share it.
+ */
 bool
-hbsdmon_zfs_init(hbsdmon_node_t *node)
+hbsdmon_zfs_add_pool(hbsdmon_ctx_t *ctx, hbsdmon_node_t *node,
+    const char *name)
 {
-	libzfs_handle_t *zfshandle;
-	zpool_handle_t *poolhandle;
-	hbsdmon_keyvalue_t *kv;
-	char *pool;
+	hbsdmon_zpool_t *pool;
 
-	kv = hbsdmon_find_kv_in_node(node, "pool", false);
-	if (kv == NULL) {
-		return (true);
+	if (ctx->hc_zfs == NULL) {
+		ctx->hc_zfs = hbsdmon_zfs_new(NULL);
+		if (ctx->hc_zfs == NULL) {
+			return (false);
+		}
 	}
 
-	zfshandle = libzfs_init();
-	if (zfshandle == NULL) {
-		fprintf(stderr, "[-] libzfs_init failed.\n");
-		return (false);
+	SLIST_FOREACH(pool, &(ctx->hc_zfs->hz_pools), hzp_entry) {
+		if (strcmp(pool->hzp_name, name) == 0) {
+			node->hn_zpool = pool;
+			return (true);
+		}
 	}
 
-	pool = hbsdmon_keyvalue_to_str(kv);
-	poolhandle = zpool_open(zfshandle, pool);
-	if (poolhandle == NULL) {
-		fprintf(stderr, "[-] zpool_open(%s) failed.\n", pool);
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
 		return (false);
 	}
 
-	kv = hbsdmon_new_keyvalue();
-	if (kv == NULL) {
+	pool->hzp_name = strdup(name);
+	if (pool->hzp_name == NULL) {
+		free(pool);
 		return (false);
 	}
 
-	if (!hbsdmon_keyvalue_store(kv, "zfshandle", &zfshandle,
-	    sizeof(zfshandle))) {
-		return (false);
+	SLIST_INSERT_HEAD(&(ctx->hc_zfs->hz_pools), pool, hzp_entry);
+	ctx->hc_zfs->hz_npools++;
+	node->hn_zpool = pool;
+
+	return (true);
+}
+
+/*
+ * Open the backend, take a first look at the pools and start
+ * listening for ZFS events. A pool that can't be found isn't fatal:
+ * its nodes fail until it shows up.
+ */
+bool
+hbsdmon_zfs_init(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_zpool_t *pool;
+	hbsdmon_zfs_t *zfs;
+
+	zfs = ctx->hc_zfs;
+	if (zfs == NULL) {
+		return (true);
 	}
-	hbsdmon_node_append_kv(node, kv);
 
-	kv = hbsdmon_new_keyvalue();
-	if (kv == NULL) {
+	if (!zfs->hz_backend->hzb_open(zfs)) {
 		return (false);
 	}
 
-	if (!hbsdmon_keyvalue_store(kv, "poolhandle", &poolhandle,
-	    sizeof(poolhandle))) {
-		return (false);
+	pthread_mutex_lock(&(zfs->hz_mtx));
+	hbsdmon_zfs_refresh(zfs);
+	SLIST_FOREACH(pool, &(zfs->hz_pools), hzp_entry) {
+		if (pool->hzp_found == false) {
+			fprintf(stderr, "[-] ZFS pool %s not found.\n",
+			    pool->hzp_name);
+		}
 	}
-	hbsdmon_node_append_kv(node, kv);
+	pthread_mutex_unlock(&(zfs->hz_mtx));
 
-	return (true);
+	return (hbsdmon_zfs_events_start(ctx));
 }
 
+void
+hbsdmon_zfs_fini(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_zpool_t *pool, *tpool;
+	hbsdmon_zfs_t *zfs;
+
+	zfs = ctx->hc_zfs;
+	if (zfs == NULL) {
+		return;
+	}
+
+	if (zfs->hz_evsock != NULL) {
+		zfs->hz_evstop = true;
+		pthread_join(zfs->hz_evtid, NULL);
+		zmq_close(zfs->hz_evsock);
+		zfs->hz_evsock = NULL;
+	}
+
+	/*
+	 * A node thread that was cancelled on shutdown may have been
+	 * refreshing. Leave everything to exit() then.
+	 */
+	if (pthread_mutex_trylock(&(zfs->hz_mtx)) != 0) {
+		return;
+	}
+	pthread_mutex_unlock(&(zfs->hz_mtx));
+
+	if (zfs->hz_handle != NULL) {
+		zfs->hz_backend->hzb_close(zfs);
+	}
+
+	SLIST_FOREACH_SAFE(pool, &(zfs->hz_pools), hzp_entry, tpool) {
+		free(pool->hzp_name);
+		free(pool);
+	}
+
+	pthread_mutex_destroy(&(zfs->hz_mtx));
+	free(zfs->hz_mockfile);
+	free(zfs->hz_mockevents);
+	free(zfs);
+	ctx->hc_zfs = NULL;
+}
+
+/*
+ * The main thread's end of the event thread's socket, or NULL
+ * without events.
+ */
+void *
+hbsdmon_zfs_socket(hbsdmon_ctx_t *ctx)
+{
+
+	if (ctx->hc_zfs == NULL) {
+		return (NULL);
+	}
+
+	return (ctx->hc_zfs->hz_evsock);
+}
+
+/*
+ * The event thread saw something happen to a pool, or to all of them
+ * if it lost events. Have the nodes watching it probe right away.
+ */
+void
+hbsdmon_zfs_recv(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_thread_msg_t msg;
+	hbsdmon_node_t *node, *tnode;
+	hbsdmon_zpool_t *pool;
+
+	if (zmq_recv(ctx->hc_zfs->hz_evsock, &msg, sizeof(msg),
+	    ZMQ_DONTWAIT) != sizeof(msg)) {
+		return;
+	}
+
+	pool = msg.htm_void;
+	SLIST_FOREACH_SAFE(node, &(ctx->hc_nodes), hn_entry, tnode) {
+		if (node->hn_method != METHOD_ZFS ||
+		    (pool != NULL && node->hn_zpool != pool)) {
+			continue;
+		}
+		hbsdmon_node_tell(node, VERB_PROBE, 0, 0);
+	}
+}
+
+/*
+ * Report whether the node's pool is healthy and within the node's
+ * thresholds. The first node to ask after HBSDMON_ZFS_REFRESH_MS
+ * refreshes every pool. The others use the results of that pass.
+ * While events are coming in, pools are only refreshed after an
+ * event or when reconciliation is due.
+ */
 bool
 hbsdmon_zfs_status(hbsdmon_node_t *node)
 {
-	zpool_handle_t *poolhandle;
-	hbsdmon_keyvalue_t *kv;
-	zpool_errata_t errata;
-	zpool_status_t reason;
-	char *msgid;
-
-	kv = hbsdmon_find_kv_in_node(node, "poolhandle", false);
-	if (kv == NULL) {
-		fprintf(stderr, "[-] poolhandle not set!\n");
+	uint64_t now, ttl;
+	hbsdmon_zfs_t *zfs;
+	bool refreshed, res;
+
+	zfs = node->hn_thread->ht_ctx->hc_zfs;
+	if (zfs == NULL || node->hn_zpool == NULL) {
+		fprintf(stderr, "[-] pool not set!\n");
 		return (true);
 	}
 
-	poolhandle = *((zpool_handle_t **)kv->hk_value);
+	refreshed = false;
+	pthread_mutex_lock(&(zfs->hz_mtx));
+	now = hbsdmon_now_ms();
+	ttl = zfs->hz_events ? zfs->hz_reconcile_ms : HBSDMON_ZFS_REFRESH_MS;
+	if (now - zfs->hz_refreshed >= ttl) {
+		hbsdmon_zfs_refresh(zfs);
+		refreshed = true;
+	}
+	res = node->hn_zpool->hzp_healthy &&
+	    hbsdmon_zfs_check_limits(node->hn_zlimits, node->hn_zpool,
+	    NULL) == 0;
+	pthread_mutex_unlock(&(zfs->hz_mtx));
+
+	if (refreshed) {
+		hbsdmon_node_lock_ctx(node);
+		node->hn_thread->ht_ctx->hc_stats.hs_nzfsrefreshes++;
+		hbsdmon_node_unlock_ctx(node);
+	}
+
+	return (res);
+}
+
+/*
+ * Describe the node's pool as of the last refresh, for notifications:
+ * its state and metrics, the vdevs with errors and the thresholds
+ * that were exceeded.
+ */
+void
+hbsdmon_zfs_to_sbuf(hbsdmon_node_t *node, struct sbuf *sb)
+{
+	hbsdmon_zpool_t *pool;
+	hbsdmon_vdev_t *vdev;
+	hbsdmon_zfs_t *zfs;
+	size_t i;
+
+	zfs = node->hn_thread->ht_ctx->hc_zfs;
+	pool = node->hn_zpool;
+	if (zfs == NULL || pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&(zfs->hz_mtx));
+	if (pool->hzp_found == false) {
+		sbuf_cat(sb, "\nPool state: not found\n");
+		pthread_mutex_unlock(&(zfs->hz_mtx));
+		return;
+	}
+
+	sbuf_printf(sb, "\nPool state: %s", pool->hzp_state);
+	if (pool->hzp_msgid[0] != '\0') {
+		sbuf_printf(sb, " (see %s)", pool->hzp_msgid);
+	}
+	if (pool->hzp_errata != 0) {
+		sbuf_printf(sb, " (errata %ju)", (uintmax_t)pool->hzp_errata);
+	}
+	sbuf_cat(sb, "\n");
+	hbsdmon_zfs_metrics_to_sbuf(pool, sb);
+
+	for (i = 0; i < pool->hzp_nvdevs; i++) {
+		vdev = &(pool->hzp_vdevs[i]);
+		if (vdev->hv_read_errors + vdev->hv_write_errors +
+		    vdev->hv_cksum_errors == 0) {
+			continue;
+		}
+		sbuf_printf(sb, "%s: %ju read, %ju write, %ju checksum"
+		    " errors\n", vdev->hv_name,
+		    (uintmax_t)vdev->hv_read_errors,
+		    (uintmax_t)vdev->hv_write_errors,
+		    (uintmax_t)vdev->hv_cksum_errors);
+	}
+
+	hbsdmon_zfs_check_limits(node->hn_zlimits, pool, sb);
+	pthread_mutex_unlock(&(zfs->hz_mtx));
+}
+
+/*
+ * Metrics of every pool, and the history of their latencies, for the
+ * stats.
+ */
+void
+hbsdmon_zfs_stats_to_sbuf(hbsdmon_ctx_t *ctx, struct sbuf *sb)
+{
+	hbsdmon_zpool_t *pool;
+	hbsdmon_zfs_t *zfs;
+	char name[HBSDMON_ZPOOL_VDEVLEN + 32];
+
+	zfs = ctx->hc_zfs;
+	if (zfs == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&(zfs->hz_mtx));
+	SLIST_FOREACH(pool, &(zfs->hz_pools), hzp_entry) {
+		sbuf_printf(sb, "Pool %s: %s\n", pool->hzp_name,
+		    pool->hzp_found ? pool->hzp_state : "not found");
+		if (pool->hzp_found == false) {
+			continue;
+		}
+		hbsdmon_zfs_metrics_to_sbuf(pool, sb);
+		snprintf(name, sizeof(name), "%s read latency",
+		    pool->hzp_name);
+		hbsdmon_hist_to_sbuf(sb, name, &(pool->hzp_rlat));
+		snprintf(name, sizeof(name), "%s write latency",
+		    pool->hzp_name);
+		hbsdmon_hist_to_sbuf(sb, name, &(pool->hzp_wlat));
+	}
+	pthread_mutex_unlock(&(zfs->hz_mtx));
+}
+
+/*
+ * Refresh every pool through the backend, then record the pools'
+ * latencies. Called with the mutex held.
+ */
+static void
+hbsdmon_zfs_refresh(hbsdmon_zfs_t *zfs)
+{
+	hbsdmon_zpool_t *pool;
+
+	zfs->hz_backend->hzb_refresh(zfs);
+	zfs->hz_refreshed = hbsdmon_now_ms();
+
+	SLIST_FOREACH(pool, &(zfs->hz_pools), hzp_entry) {
+		if (pool->hzp_found == false) {
+			continue;
+		}
+		hbsdmon_hist_add(&(pool->hzp_rlat),
+		    pool->hzp_root.hv_rlat_us / 1000);
+		hbsdmon_hist_add(&(pool->hzp_wlat),
+		    pool->hzp_root.hv_wlat_us / 1000);
+	}
+}
+
+static void
+hbsdmon_zfs_metrics_to_sbuf(hbsdmon_zpool_t *pool, struct sbuf *sb)
+{
+
+	sbuf_printf(sb, "Capacity: %d%%", pool->hzp_capacity);
+	if (pool->hzp_frag >= 0) {
+		sbuf_printf(sb, ", fragmentation: %d%%", pool->hzp_frag);
+	}
+	sbuf_cat(sb, "\n");
 
-	msgid = NULL;
-	errata = 0;
-	reason = 0;
-	reason = zpool_get_status(poolhandle, &msgid, &errata);
-	switch (reason) {
-	case ZPOOL_STATUS_OK:
-	case ZPOOL_STATUS_VERSION_OLDER:
-	case ZPOOL_STATUS_FEAT_DISABLED:
-	case ZPOOL_STATUS_COMPATIBILITY_ERR:
+	if (pool->hzp_scan != ZSCAN_NONE) {
+		sbuf_printf(sb, "%s: %s, %d%% done\n",
+		    hbsdmon_zscan_to_str(pool->hzp_scan),
+		    pool->hzp_scanning ? "in progress" : "finished",
+		    pool->hzp_scan_pct);
+	}
+
+	sbuf_printf(sb, "Latency: read %.1f ms, write %.1f ms\n",
+	    (double)pool->hzp_root.hv_rlat_us / 1000,
+	    (double)pool->hzp_root.hv_wlat_us / 1000);
+}
+
+/*
+ * Check a node's thresholds against its pool. Describe each one
+ * that's exceeded to sb, if not NULL, and return how many were.
+ */
+static size_t
+hbsdmon_zfs_check_limits(hbsdmon_zfs_limits_t *limits,
+    hbsdmon_zpool_t *pool, struct sbuf *sb)
+{
+	hbsdmon_vdev_t *vdev;
+	uint64_t errors, latency;
+	size_t i, nexceeded;
+
+	if (limits == NULL || pool->hzp_found == false) {
+		return (0);
+	}
+
+	nexceeded = 0;
+	if (limits->hzl_capacity >= 0 &&
+	    pool->hzp_capacity > limits->hzl_capacity) {
+		if (sb != NULL) {
+			sbuf_printf(sb, "Capacity %d%% is above %jd%%\n",
+			    pool->hzp_capacity,
+			    (intmax_t)limits->hzl_capacity);
+		}
+		nexceeded++;
+	}
+
+	if (limits->hzl_frag >= 0 && pool->hzp_frag > limits->hzl_frag) {
+		if (sb != NULL) {
+			sbuf_printf(sb, "Fragmentation %d%% is above %jd%%\n",
+			    pool->hzp_frag, (intmax_t)limits->hzl_frag);
+		}
+		nexceeded++;
+	}
+
+	if (limits->hzl_errors >= 0) {
+		for (i = 0; i < pool->hzp_nvdevs; i++) {
+			vdev = &(pool->hzp_vdevs[i]);
+			errors = vdev->hv_read_errors +
+			    vdev->hv_write_errors + vdev->hv_cksum_errors;
+			if (errors <= (uint64_t)limits->hzl_errors) {
+				continue;
+			}
+			if (sb != NULL) {
+				sbuf_printf(sb, "%s has %ju errors, more"
+				    " than %jd\n", vdev->hv_name,
+				    (uintmax_t)errors,
+				    (intmax_t)limits->hzl_errors);
+			}
+			nexceeded++;
+		}
+	}
+
+	if (limits->hzl_latency_ms >= 0) {
+		latency = MAX(pool->hzp_root.hv_rlat_us,
+		    pool->hzp_root.hv_wlat_us);
+		if (latency > (uint64_t)limits->hzl_latency_ms * 1000) {
+			if (sb != NULL) {
+				sbuf_printf(sb, "Latency %.1f ms is above"
+				    " %jd ms\n", (double)latency / 1000,
+				    (intmax_t)limits->hzl_latency_ms);
+			}
+			nexceeded++;
+		}
+	}
+
+	return (nexceeded);
+}
+
+/*
+ * Listen for ZFS events, if the backend can and it's wanted. Without
+ * events, pools are polled as before.
+ */
+static bool
+hbsdmon_zfs_events_start(hbsdmon_ctx_t *ctx)
+{
+	hbsdmon_zfs_t *zfs;
+
+	zfs = ctx->hc_zfs;
+	if (zfs->hz_wantevents == false ||
+	    zfs->hz_backend->hzb_events_open == NULL) {
+		return (true);
+	}
+
+	if (!zfs->hz_backend->hzb_events_open(zfs)) {
+		fprintf(stderr, "[-] Can't listen for ZFS events."
+		    " Polling pools instead.\n");
 		return (true);
-	default:
+	}
+
+	zfs->hz_evsock = zmq_socket(ctx->hc_zmq, ZMQ_PAIR);
+	if (zfs->hz_evsock == NULL) {
+		zfs->hz_backend->hzb_events_close(zfs);
+		return (false);
+	}
+
+	if (zmq_bind(zfs->hz_evsock, "inproc://zfs_events")) {
+		zmq_close(zfs->hz_evsock);
+		zfs->hz_evsock = NULL;
+		zfs->hz_backend->hzb_events_close(zfs);
 		return (false);
 	}
+
+	zfs->hz_events = true;
+	if (pthread_create(&(zfs->hz_evtid), NULL, hbsdmon_zfs_events_run,
+	    ctx)) {
+		zfs->hz_events = false;
+		zmq_close(zfs->hz_evsock);
+		zfs->hz_evsock = NULL;
+		zfs->hz_backend->hzb_events_close(zfs);
+		return (false);
+	}
+
+	return (true);
+}
+
+/*
+ * The event thread. Every relevant event invalidates the pools'
+ * status and has the nodes watching the pool probe it. If events
+ * stop working, pools go back to being polled.
+ */
+static void *
+hbsdmon_zfs_events_run(void *argp)
+{
+	hbsdmon_thread_msg_t msg;
+	hbsdmon_zpool_t *pool;
+	hbsdmon_zevent_t ev;
+	hbsdmon_ctx_t *ctx;
+	hbsdmon_zfs_t *zfs;
+	void *zmqsock;
+	int res;
+
+	ctx = argp;
+	zfs = ctx->hc_zfs;
+
+	zmqsock = zmq_socket(ctx->hc_zmq, ZMQ_PAIR);
+	if (zmqsock == NULL) {
+		zfs->hz_events = false;
+		return (NULL);
+	}
+	if (zmq_connect(zmqsock, "inproc://zfs_events")) {
+		zmq_close(zmqsock);
+		zfs->hz_events = false;
+		return (NULL);
+	}
+
+	while (zfs->hz_evstop == false && ctx->hc_stopping == false) {
+		res = zfs->hz_backend->hzb_events_next(zfs, &ev,
+		    HBSDMON_ABORT_POLL_MS);
+		if (res < 0) {
+			fprintf(stderr, "[-] Lost the ZFS event stream."
+			    " Polling pools instead.\n");
+			break;
+		}
+		if (res == 0 || !hbsdmon_zfs_event_relevant(&ev)) {
+			continue;
+		}
+
+		pthread_mutex_lock(&(zfs->hz_mtx));
+		pool = NULL;
+		if (ev.hze_dropped == 0) {
+			SLIST_FOREACH(pool, &(zfs->hz_pools), hzp_entry) {
+				if (strcmp(pool->hzp_name, ev.hze_pool) == 0) {
+					break;
+				}
+			}
+			if (pool == NULL) {
+				/* Not one of ours. */
+				pthread_mutex_unlock(&(zfs->hz_mtx));
+				continue;
+			}
+		}
+		zfs->hz_refreshed = 0;
+		pthread_mutex_unlock(&(zfs->hz_mtx));
+
+		hbsdmon_lock_ctx(ctx);
+		ctx->hc_stats.hs_nzfsevents++;
+		hbsdmon_unlock_ctx(ctx);
+
+		memset(&msg, 0, sizeof(msg));
+		msg.htm_verb = VERB_PROBE;
+		msg.htm_void = pool;
+		zmq_send(zmqsock, &msg, sizeof(msg), 0);
+	}
+
+	pthread_mutex_lock(&(zfs->hz_mtx));
+	zfs->hz_events = false;
+	pthread_mutex_unlock(&(zfs->hz_mtx));
+	zfs->hz_backend->hzb_events_close(zfs);
+	zmq_close(zmqsock);
+
+	return (NULL);
+}
+
+/*
+ * Vdev state changes, I/O errors and checksum errors matter. Lost
+ * events may have been any of them. Classes are matched on their
+ * last component, as in resource.fs.zfs.statechange.
+ */
+static bool
+hbsdmon_zfs_event_relevant(const hbsdmon_zevent_t *ev)
+{
+	const char *class;
+
+	if (ev->hze_dropped > 0) {
+		return (true);
+	}
+
+	class = strrchr(ev->hze_class, '.');
+	class = (class != NULL) ? class + 1 : ev->hze_class;
+
+	return (strcmp(class, "statechange") == 0 ||
+	    strcmp(class, "io") == 0 ||
+	    strcmp(class, "checksum") == 0);
 }
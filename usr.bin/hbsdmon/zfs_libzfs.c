@@ -0,0 +1,427 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/param.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/queue.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libzfs.h>
+#include <libzfs_core.h>
+
+#include "hbsdmon.h"
+
+/* Deepest vdev tree walked. Real trees are three levels deep. */
+#define	ZFS_WALK_DEPTH	8
+
+static bool hbsdmon_zfs_libzfs_open(hbsdmon_zfs_t *);
+static void hbsdmon_zfs_libzfs_close(hbsdmon_zfs_t *);
+static void hbsdmon_zfs_libzfs_refresh(hbsdmon_zfs_t *);
+static void hbsdmon_zfs_libzfs_lost(hbsdmon_zpool_t *);
+static bool hbsdmon_zfs_libzfs_events_open(hbsdmon_zfs_t *);
+static int hbsdmon_zfs_libzfs_events_next(hbsdmon_zfs_t *,
+    hbsdmon_zevent_t *, int);
+static void hbsdmon_zfs_libzfs_events_close(hbsdmon_zfs_t *);
+static void hbsdmon_zfs_libzfs_walk(hbsdmon_zpool_t *, nvlist_t *);
+static void hbsdmon_zfs_libzfs_vdev(hbsdmon_vdev_t *, nvlist_t *,
+    vdev_stat_t *);
+static void hbsdmon_zfs_libzfs_latency(nvlist_t *, const char *,
+    uint64_t *, uint64_t *, uint64_t *);
+
+const hbsdmon_zfs_backend_t hbsdmon_zfs_libzfs = {
+	.hzb_name = "libzfs",
+	.hzb_open = hbsdmon_zfs_libzfs_open,
+	.hzb_close = hbsdmon_zfs_libzfs_close,
+	.hzb_refresh = hbsdmon_zfs_libzfs_refresh,
+	.hzb_events_open = hbsdmon_zfs_libzfs_events_open,
+	.hzb_events_next = hbsdmon_zfs_libzfs_events_next,
+	.hzb_events_close = hbsdmon_zfs_libzfs_events_close,
+};
+
+/*
+ * One libzfs handle serves every pool. libzfs isn't thread-safe, so
+ * it's only used with the ZFS layer's mutex held.
+ */
+static bool
+hbsdmon_zfs_libzfs_open(hbsdmon_zfs_t *zfs)
+{
+
+	zfs->hz_handle = libzfs_init();
+	if (zfs->hz_handle == NULL) {
+		fprintf(stderr, "[-] libzfs_init failed.\n");
+		return (false);
+	}
+
+	libzfs_print_on_error(zfs->hz_handle, B_FALSE);
+
+	return (true);
+}
+
+static void
+hbsdmon_zfs_libzfs_close(hbsdmon_zfs_t *zfs)
+{
+	hbsdmon_zpool_t *pool;
+
+	SLIST_FOREACH(pool, &(zfs->hz_pools), hzp_entry) {
+		if (pool->hzp_handle != NULL) {
+			zpool_close(pool->hzp_handle);
+			pool->hzp_handle = NULL;
+		}
+	}
+
+	libzfs_fini(zfs->hz_handle);
+	zfs->hz_handle = NULL;
+}
+
+/*
+ * Pools stay open between refreshes. Refreshing a pool re-reads its
+ * config and stats from the kernel. Faulted pools are opened too, so
+ * that they can be reported. All metrics then come from one walk of
+ * the pool's config.
+ */
+static void
+hbsdmon_zfs_libzfs_refresh(hbsdmon_zfs_t *zfs)
+{
+	zpool_handle_t *poolhandle;
+	zpool_errata_t errata;
+	zpool_status_t reason;
+	hbsdmon_zpool_t *pool;
+	boolean_t missing;
+	nvlist_t *config, *nvroot;
+	const char *msgid;
+
+	SLIST_FOREACH(pool, &(zfs->hz_pools), hzp_entry) {
+		poolhandle = pool->hzp_handle;
+		if (poolhandle == NULL) {
+			poolhandle = zpool_open_canfail(zfs->hz_handle,
+			    pool->hzp_name);
+			if (poolhandle == NULL) {
+				hbsdmon_zfs_libzfs_lost(pool);
+				continue;
+			}
+			pool->hzp_handle = poolhandle;
+		} else {
+			missing = B_FALSE;
+			if (zpool_refresh_stats(poolhandle, &missing) != 0 ||
+			    missing) {
+				zpool_close(poolhandle);
+				pool->hzp_handle = NULL;
+				hbsdmon_zfs_libzfs_lost(pool);
+				continue;
+			}
+		}
+
+		msgid = NULL;
+		errata = 0;
+		reason = zpool_get_status(poolhandle, &msgid, &errata);
+		switch (reason) {
+		case ZPOOL_STATUS_OK:
+		case ZPOOL_STATUS_VERSION_OLDER:
+		case ZPOOL_STATUS_FEAT_DISABLED:
+		case ZPOOL_STATUS_COMPATIBILITY_ERR:
+			pool->hzp_healthy = true;
+			break;
+		default:
+			pool->hzp_healthy = false;
+			break;
+		}
+
+		pool->hzp_found = true;
+		strlcpy(pool->hzp_state, zpool_get_state_str(poolhandle),
+		    sizeof(pool->hzp_state));
+		strlcpy(pool->hzp_msgid, msgid != NULL ? msgid : "",
+		    sizeof(pool->hzp_msgid));
+		pool->hzp_errata = errata;
+
+		config = zpool_get_config(poolhandle, NULL);
+		if (config != NULL && nvlist_lookup_nvlist(config,
+		    ZPOOL_CONFIG_VDEV_TREE, &nvroot) == 0) {
+			hbsdmon_zfs_libzfs_walk(pool, nvroot);
+		}
+	}
+}
+
+/*
+ * Collect the pool's metrics from its vdev tree: capacity,
+ * fragmentation and latency from the root vdev, scrub or resilver
+ * progress from its scan stats and error counts and latency of each
+ * leaf vdev.
+ */
+static void
+hbsdmon_zfs_libzfs_walk(hbsdmon_zpool_t *pool, nvlist_t *nvroot)
+{
+	nvlist_t **stack[ZFS_WALK_DEPTH], **children;
+	uint_t nchildren, nstack[ZFS_WALK_DEPTH], depth, c;
+	pool_scan_stat_t *ps;
+	vdev_stat_t *vs;
+	nvlist_t *nv;
+	size_t nvdevs;
+
+	if (nvlist_lookup_uint64_array(nvroot, ZPOOL_CONFIG_VDEV_STATS,
+	    (uint64_t **)&vs, &c) != 0) {
+		return;
+	}
+
+	pool->hzp_capacity = (vs->vs_space != 0) ?
+	    (int)(vs->vs_alloc * 100 / vs->vs_space) : 0;
+	pool->hzp_frag = (vs->vs_fragmentation <= 100) ?
+	    (int)vs->vs_fragmentation : -1;
+	hbsdmon_zfs_libzfs_vdev(&(pool->hzp_root), nvroot, vs);
+
+	pool->hzp_scan = ZSCAN_NONE;
+	pool->hzp_scanning = false;
+	pool->hzp_scan_pct = 0;
+	if (nvlist_lookup_uint64_array(nvroot, ZPOOL_CONFIG_SCAN_STATS,
+	    (uint64_t **)&ps, &c) == 0) {
+		switch (ps->pss_func) {
+		case POOL_SCAN_SCRUB:
+			pool->hzp_scan = ZSCAN_SCRUB;
+			break;
+		case POOL_SCAN_RESILVER:
+			pool->hzp_scan = ZSCAN_RESILVER;
+			break;
+		default:
+			break;
+		}
+		pool->hzp_scanning = (ps->pss_state == DSS_SCANNING);
+		if (ps->pss_state == DSS_FINISHED) {
+			pool->hzp_scan_pct = 100;
+		} else if (ps->pss_to_examine != 0) {
+			pool->hzp_scan_pct = (int)(ps->pss_issued * 100 /
+			    ps->pss_to_examine);
+		}
+	}
+
+	/*
+	 * Depth-first over the tree, without recursion. Leaves keep
+	 * their slot from one refresh to the next as long as the tree
+	 * doesn't change, which the latency deltas rely on.
+	 */
+	nvdevs = 0;
+	depth = 0;
+	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
+	    &children, &nchildren) != 0) {
+		pool->hzp_nvdevs = 0;
+		return;
+	}
+	stack[0] = children;
+	nstack[0] = nchildren;
+	depth = 1;
+
+	while (depth > 0) {
+		if (nstack[depth - 1] == 0) {
+			depth--;
+			continue;
+		}
+		nv = *(stack[depth - 1]++);
+		nstack[depth - 1]--;
+
+		if (nvlist_lookup_nvlist_array(nv, ZPOOL_CONFIG_CHILDREN,
+		    &children, &nchildren) == 0 && nchildren > 0) {
+			if (depth < ZFS_WALK_DEPTH) {
+				stack[depth] = children;
+				nstack[depth] = nchildren;
+				depth++;
+			}
+			continue;
+		}
+
+		if (nvdevs == HBSDMON_ZPOOL_VDEVS ||
+		    nvlist_lookup_uint64_array(nv, ZPOOL_CONFIG_VDEV_STATS,
+		    (uint64_t **)&vs, &c) != 0) {
+			continue;
+		}
+		hbsdmon_zfs_libzfs_vdev(&(pool->hzp_vdevs[nvdevs++]), nv, vs);
+	}
+
+	pool->hzp_nvdevs = nvdevs;
+}
+
+static void
+hbsdmon_zfs_libzfs_vdev(hbsdmon_vdev_t *vdev, nvlist_t *nv,
+    vdev_stat_t *vs)
+{
+	const char *name, *p;
+	nvlist_t *nvx;
+
+	if (nvlist_lookup_string(nv, ZPOOL_CONFIG_PATH, &name) == 0) {
+		p = strrchr(name, '/');
+		if (p != NULL) {
+			name = p + 1;
+		}
+	} else if (nvlist_lookup_string(nv, ZPOOL_CONFIG_TYPE,
+	    &name) != 0) {
+		name = "?";
+	}
+
+	if (strcmp(vdev->hv_name, name) != 0) {
+		/* A different vdev than last time. Start over. */
+		memset(vdev, 0, sizeof(*vdev));
+		strlcpy(vdev->hv_name, name, sizeof(vdev->hv_name));
+	}
+
+	vdev->hv_read_errors = vs->vs_read_errors;
+	vdev->hv_write_errors = vs->vs_write_errors;
+	vdev->hv_cksum_errors = vs->vs_checksum_errors;
+
+	if (nvlist_lookup_nvlist(nv, ZPOOL_CONFIG_VDEV_STATS_EX,
+	    &nvx) == 0) {
+		hbsdmon_zfs_libzfs_latency(nvx,
+		    ZPOOL_CONFIG_VDEV_TOT_R_LAT_HISTO, &(vdev->hv_rops),
+		    &(vdev->hv_rsum), &(vdev->hv_rlat_us));
+		hbsdmon_zfs_libzfs_latency(nvx,
+		    ZPOOL_CONFIG_VDEV_TOT_W_LAT_HISTO, &(vdev->hv_wops),
+		    &(vdev->hv_wsum), &(vdev->hv_wlat_us));
+	}
+}
+
+/*
+ * The kernel keeps cumulative latency histograms with power-of-two
+ * nanosecond buckets. Estimate the mean latency since the last
+ * refresh from how they grew, taking the middle of each bucket.
+ * Without new I/O, the last mean stands.
+ */
+static void
+hbsdmon_zfs_libzfs_latency(nvlist_t *nvx, const char *histname,
+    uint64_t *opsp, uint64_t *sump, uint64_t *meanp)
+{
+	uint64_t *histo, ops, sum;
+	uint_t c, i;
+
+	if (nvlist_lookup_uint64_array(nvx, histname, &histo, &c) != 0) {
+		return;
+	}
+
+	ops = sum = 0;
+	for (i = 0; i < c && i < 64; i++) {
+		ops += histo[i];
+		sum += histo[i] * ((1ULL << i) + (1ULL << i) / 2);
+	}
+
+	if (ops > *opsp && sum >= *sump) {
+		*meanp = (sum - *sump) / (ops - *opsp) / 1000;
+	}
+	*opsp = ops;
+	*sump = sum;
+}
+
+static void
+hbsdmon_zfs_libzfs_lost(hbsdmon_zpool_t *pool)
+{
+
+	pool->hzp_found = false;
+	pool->hzp_healthy = false;
+	pool->hzp_state[0] = '\0';
+}
+
+/*
+ * Events are read from their own descriptor on the ZFS device, which
+ * keeps our place in the kernel's event queue.
+ */
+static bool
+hbsdmon_zfs_libzfs_events_open(hbsdmon_zfs_t *zfs)
+{
+
+	zfs->hz_evfd = open(ZFS_DEV, O_RDWR | O_CLOEXEC);
+	if (zfs->hz_evfd == -1) {
+		fprintf(stderr, "[-] open(%s): %s\n", ZFS_DEV,
+		    strerror(errno));
+		return (false);
+	}
+
+	return (true);
+}
+
+/*
+ * zpool_events_next() can block, but not in a way that can be
+ * interrupted on shutdown. Ask without blocking and sleep in between
+ * instead.
+ */
+static int
+hbsdmon_zfs_libzfs_events_next(hbsdmon_zfs_t *zfs, hbsdmon_zevent_t *ev,
+    int timeout)
+{
+	const char *str, *p;
+	nvlist_t *nvl;
+	int dropped, error;
+
+	nvl = NULL;
+	dropped = 0;
+	pthread_mutex_lock(&(zfs->hz_mtx));
+	error = zpool_events_next(zfs->hz_handle, &nvl, &dropped,
+	    ZEVENT_NONBLOCK, zfs->hz_evfd);
+	pthread_mutex_unlock(&(zfs->hz_mtx));
+	if (error != 0) {
+		return (-1);
+	}
+
+	if (nvl == NULL && dropped == 0) {
+		usleep(timeout * 1000);
+		return (0);
+	}
+
+	memset(ev, 0, sizeof(*ev));
+	ev->hze_dropped = (uint64_t)dropped;
+	if (nvl == NULL) {
+		return (1);
+	}
+
+	if (nvlist_lookup_string(nvl, FM_CLASS, &str) == 0) {
+		strlcpy(ev->hze_class, str, sizeof(ev->hze_class));
+	}
+	if (nvlist_lookup_string(nvl, FM_EREPORT_PAYLOAD_ZFS_POOL,
+	    &str) == 0) {
+		strlcpy(ev->hze_pool, str, sizeof(ev->hze_pool));
+	}
+	if (nvlist_lookup_string(nvl, FM_EREPORT_PAYLOAD_ZFS_VDEV_PATH,
+	    &str) == 0) {
+		p = strrchr(str, '/');
+		strlcpy(ev->hze_vdev, p != NULL ? p + 1 : str,
+		    sizeof(ev->hze_vdev));
+	}
+	nvlist_free(nvl);
+
+	return (1);
+}
+
+static void
+hbsdmon_zfs_libzfs_events_close(hbsdmon_zfs_t *zfs)
+{
+
+	if (zfs->hz_evfd != -1) {
+		close(zfs->hz_evfd);
+		zfs->hz_evfd = -1;
+	}
+}
@@ -0,0 +1,367 @@
+/*-
+ * Copyright (c) 2026 HardenedBSD Foundation Corp.
+ * Author: Shawn Webb <shawn.webb@hardenedbsd.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/queue.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <ucl.h>
+
+#include "hbsdmon.h"
+
+static bool hbsdmon_zfs_mock_open(hbsdmon_zfs_t *);
+static void hbsdmon_zfs_mock_close(hbsdmon_zfs_t *);
+static void hbsdmon_zfs_mock_refresh(hbsdmon_zfs_t *);
+static void hbsdmon_zfs_mock_pool(hbsdmon_zpool_t *, const ucl_object_t *);
+static int64_t hbsdmon_zfs_mock_int(const ucl_object_t *, const char *,
+    int64_t);
+static bool hbsdmon_zfs_mock_events_open(hbsdmon_zfs_t *);
+static int hbsdmon_zfs_mock_events_next(hbsdmon_zfs_t *,
+    hbsdmon_zevent_t *, int);
+static void hbsdmon_zfs_mock_events_close(hbsdmon_zfs_t *);
+static bool hbsdmon_zfs_mock_event_line(hbsdmon_zfs_t *,
+    hbsdmon_zevent_t *);
+
+/*
+ * A backend without real pools, for testing. Pool states and metrics
+ * are read from a UCL file on every refresh, so they can be changed
+ * under a running instance. Everything but the state is optional:
+ *
+ * rpool: { state: "ONLINE" },
+ * tank: {
+ *	state: "DEGRADED",
+ *	msgid: "ZFS-8000-9P",
+ *	capacity: 91,			# Percent
+ *	fragmentation: 40,		# Percent
+ *	scan: "scrub",			# Or "resilver"
+ *	scan_progress: 34,		# Percent, done at 100
+ *	read_us: 800,			# Mean latencies
+ *	write_us: 1200,
+ *	vdevs: {
+ *		ada0: { read: 0, write: 0, checksum: 3 },
+ *	},
+ * },
+ *
+ * Pools that are ONLINE are healthy. Pools missing from the file
+ * aren't found.
+ *
+ * Fake events are read from a FIFO (zfs.mock_events), one per line:
+ * the event class, the pool and optionally the vdev, such as
+ * "ereport.fs.zfs.checksum tank ada0". A line reading "dropped"
+ * stands for lost events.
+ */
+const hbsdmon_zfs_backend_t hbsdmon_zfs_mock = {
+	.hzb_name = "mock",
+	.hzb_open = hbsdmon_zfs_mock_open,
+	.hzb_close = hbsdmon_zfs_mock_close,
+	.hzb_refresh = hbsdmon_zfs_mock_refresh,
+	.hzb_events_open = hbsdmon_zfs_mock_events_open,
+	.hzb_events_next = hbsdmon_zfs_mock_events_next,
+	.hzb_events_close = hbsdmon_zfs_mock_events_close,
+};
+
+static bool
+hbsdmon_zfs_mock_open(hbsdmon_zfs_t *zfs)
+{
+
+	if (zfs->hz_mockfile == NULL) {
+		fprintf(stderr, "[-] The mock ZFS backend needs zfs.mock"
+		    " to be set.\n");
+		return (false);
+	}
+
+	zfs->hz_handle = zfs->hz_mockfile;
+	if (zfs->hz_mockevents == NULL) {
+		/* Just poll. */
+		zfs->hz_wantevents = false;
+	}
+
+	return (true);
+}
+
+static void
+hbsdmon_zfs_mock_close(hbsdmon_zfs_t *zfs)
+{
+
+	zfs->hz_handle = NULL;
+}
+
+static void
+hbsdmon_zfs_mock_refresh(hbsdmon_zfs_t *zfs)
+{
+	struct ucl_parser *parser;
+	const ucl_object_t *obj;
+	hbsdmon_zpool_t *pool;
+	ucl_object_t *top;
+
+	parser = ucl_parser_new(0);
+	if (parser == NULL) {
+		return;
+	}
+
+	/* Keep the last known states if the file is being rewritten. */
+	if (!ucl_parser_add_file(parser, zfs->hz_mockfile)) {
+		fprintf(stderr, "[-] Could not parse %s: %s\n",
+		    zfs->hz_mockfile, ucl_parser_get_error(parser));
+		ucl_parser_free(parser);
+		return;
+	}
+
+	top = ucl_parser_get_object(parser);
+
+	SLIST_FOREACH(pool, &(zfs->hz_pools), hzp_entry) {
+		obj = (top != NULL) ? ucl_object_lookup(top,
+		    pool->hzp_name) : NULL;
+		if (obj == NULL) {
+			pool->hzp_found = false;
+			pool->hzp_healthy = false;
+			pool->hzp_state[0] = '\0';
+			continue;
+		}
+
+		hbsdmon_zfs_mock_pool(pool, obj);
+	}
+
+	if (top != NULL) {
+		ucl_object_unref(top);
+	}
+	ucl_parser_free(parser);
+}
+
+static void
+hbsdmon_zfs_mock_pool(hbsdmon_zpool_t *pool, const ucl_object_t *obj)
+{
+	const ucl_object_t *vdevs, *vobj;
+	ucl_object_iter_t it;
+	hbsdmon_vdev_t *vdev;
+	const char *str;
+
+	str = ucl_object_tostring(ucl_object_lookup(obj, "state"));
+	if (str == NULL) {
+		str = "ONLINE";
+	}
+
+	pool->hzp_found = true;
+	pool->hzp_healthy = (strcasecmp(str, "ONLINE") == 0);
+	strlcpy(pool->hzp_state, str, sizeof(pool->hzp_state));
+
+	str = ucl_object_tostring(ucl_object_lookup(obj, "msgid"));
+	strlcpy(pool->hzp_msgid, str != NULL ? str : "",
+	    sizeof(pool->hzp_msgid));
+
+	pool->hzp_capacity = (int)hbsdmon_zfs_mock_int(obj, "capacity", 0);
+	pool->hzp_frag = (int)hbsdmon_zfs_mock_int(obj, "fragmentation",
+	    -1);
+
+	pool->hzp_scan = ZSCAN_NONE;
+	str = ucl_object_tostring(ucl_object_lookup(obj, "scan"));
+	if (str != NULL && strcasecmp(str, "scrub") == 0) {
+		pool->hzp_scan = ZSCAN_SCRUB;
+	} else if (str != NULL && strcasecmp(str, "resilver") == 0) {
+		pool->hzp_scan = ZSCAN_RESILVER;
+	}
+	pool->hzp_scan_pct = (int)hbsdmon_zfs_mock_int(obj,
+	    "scan_progress", 100);
+	pool->hzp_scanning = (pool->hzp_scan != ZSCAN_NONE &&
+	    pool->hzp_scan_pct < 100);
+
+	pool->hzp_root.hv_rlat_us = (uint64_t)hbsdmon_zfs_mock_int(obj,
+	    "read_us", 0);
+	pool->hzp_root.hv_wlat_us = (uint64_t)hbsdmon_zfs_mock_int(obj,
+	    "write_us", 0);
+
+	pool->hzp_nvdevs = 0;
+	vdevs = ucl_object_lookup(obj, "vdevs");
+	if (vdevs == NULL) {
+		return;
+	}
+
+	it = NULL;
+	while ((vobj = ucl_iterate_object(vdevs, &it, true)) != NULL &&
+	    pool->hzp_nvdevs < HBSDMON_ZPOOL_VDEVS) {
+		vdev = &(pool->hzp_vdevs[pool->hzp_nvdevs++]);
+		memset(vdev, 0, sizeof(*vdev));
+		strlcpy(vdev->hv_name, ucl_object_key(vobj),
+		    sizeof(vdev->hv_name));
+		vdev->hv_read_errors = (uint64_t)hbsdmon_zfs_mock_int(vobj,
+		    "read", 0);
+		vdev->hv_write_errors = (uint64_t)hbsdmon_zfs_mock_int(vobj,
+		    "write", 0);
+		vdev->hv_cksum_errors = (uint64_t)hbsdmon_zfs_mock_int(vobj,
+		    "checksum", 0);
+		vdev->hv_rlat_us = (uint64_t)hbsdmon_zfs_mock_int(vobj,
+		    "read_us", 0);
+		vdev->hv_wlat_us = (uint64_t)hbsdmon_zfs_mock_int(vobj,
+		    "write_us", 0);
+	}
+}
+
+static int64_t
+hbsdmon_zfs_mock_int(const ucl_object_t *obj, const char *key,
+    int64_t def)
+{
+	const ucl_object_t *val;
+
+	val = ucl_object_lookup(obj, key);
+	if (val == NULL) {
+		return (def);
+	}
+
+	return (ucl_object_toint(val));
+}
+
+/*
+ * The FIFO is opened for writing too, so it never reports EOF when a
+ * writer goes away.
+ */
+static bool
+hbsdmon_zfs_mock_events_open(hbsdmon_zfs_t *zfs)
+{
+
+	if (zfs->hz_mockevents == NULL) {
+		return (false);
+	}
+
+	zfs->hz_evfd = open(zfs->hz_mockevents,
+	    O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (zfs->hz_evfd == -1) {
+		fprintf(stderr, "[-] open(%s): %s\n", zfs->hz_mockevents,
+		    strerror(errno));
+		return (false);
+	}
+
+	zfs->hz_evlen = 0;
+
+	return (true);
+}
+
+static int
+hbsdmon_zfs_mock_events_next(hbsdmon_zfs_t *zfs, hbsdmon_zevent_t *ev,
+    int timeout)
+{
+	struct pollfd pfd;
+	ssize_t nread;
+
+	if (hbsdmon_zfs_mock_event_line(zfs, ev)) {
+		return (1);
+	}
+
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.fd = zfs->hz_evfd;
+	pfd.events = POLLIN;
+	switch (poll(&pfd, 1, timeout)) {
+	case -1:
+		return (errno == EINTR ? 0 : -1);
+	case 0:
+		return (0);
+	default:
+		break;
+	}
+
+	nread = read(zfs->hz_evfd, zfs->hz_evbuf + zfs->hz_evlen,
+	    sizeof(zfs->hz_evbuf) - zfs->hz_evlen - 1);
+	if (nread == -1) {
+		return (errno == EAGAIN || errno == EINTR ? 0 : -1);
+	}
+	zfs->hz_evlen += (size_t)nread;
+
+	if (hbsdmon_zfs_mock_event_line(zfs, ev)) {
+		return (1);
+	}
+
+	if (zfs->hz_evlen == sizeof(zfs->hz_evbuf) - 1) {
+		/* A line too long to be an event. Throw it away. */
+		zfs->hz_evlen = 0;
+	}
+
+	return (0);
+}
+
+static void
+hbsdmon_zfs_mock_events_close(hbsdmon_zfs_t *zfs)
+{
+
+	if (zfs->hz_evfd != -1) {
+		close(zfs->hz_evfd);
+		zfs->hz_evfd = -1;
+	}
+}
+
+/*
+ * Take the first complete line off the buffer and parse it into ev.
+ * Returns false if there's no complete line yet. Empty lines are
+ * skipped.
+ */
+static bool
+hbsdmon_zfs_mock_event_line(hbsdmon_zfs_t *zfs, hbsdmon_zevent_t *ev)
+{
+	char *end, *line, *word;
+	size_t len;
+
+	while ((end = memchr(zfs->hz_evbuf, '\n', zfs->hz_evlen)) != NULL) {
+		*end = '\0';
+		len = (size_t)(end - zfs->hz_evbuf) + 1;
+
+		memset(ev, 0, sizeof(*ev));
+		line = zfs->hz_evbuf;
+		word = strsep(&line, " \t");
+		if (word != NULL && strcmp(word, "dropped") == 0) {
+			ev->hze_dropped = 1;
+		} else if (word != NULL && *word != '\0') {
+			strlcpy(ev->hze_class, word, sizeof(ev->hze_class));
+			word = strsep(&line, " \t");
+			if (word != NULL) {
+				strlcpy(ev->hze_pool, word,
+				    sizeof(ev->hze_pool));
+			}
+			word = strsep(&line, " \t");
+			if (word != NULL) {
+				strlcpy(ev->hze_vdev, word,
+				    sizeof(ev->hze_vdev));
+			}
+		}
+
+		memmove(zfs->hz_evbuf, zfs->hz_evbuf + len,
+		    zfs->hz_evlen - len);
+		zfs->hz_evlen -= len;
+
+		if (ev->hze_dropped > 0 || ev->hze_class[0] != '\0') {
+			return (true);
+		}
+	}
+
+	return (false);
+}